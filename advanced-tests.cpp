@@ -1,6 +1,15 @@
 #include "shared-ptr.h"
 #include "tests-extra/test-object.h"
+#include <array>
+#include <cstdint>
 #include <gtest/gtest.h>
+#include <map>
+#include <memory_resource>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 template <typename T>
 struct custom_deleter {
@@ -222,6 +231,56 @@ TEST(shared_ptr_testing, custom_deleter_reset) {
   EXPECT_TRUE(deleted);
 }
 
+namespace {
+struct move_only_deleter {
+  explicit move_only_deleter(int* calls) : calls(calls) {}
+  move_only_deleter(move_only_deleter&&) noexcept = default;
+  move_only_deleter(const move_only_deleter&) = delete;
+
+  void operator()(test_object* object) {
+    ++*calls;
+    delete object;
+  }
+
+  int* calls;
+};
+
+struct empty_deleter {
+  void operator()(test_object* object) const {
+    delete object;
+  }
+};
+} // namespace
+
+TEST(shared_ptr_testing, move_only_deleter) {
+  test_object::no_new_instances_guard g;
+  int calls = 0;
+  {
+    shared_ptr<test_object> p(new test_object(42), move_only_deleter(&calls));
+    p.reset(new test_object(43), move_only_deleter(&calls));
+    EXPECT_EQ(1, calls);
+  }
+  EXPECT_EQ(2, calls);
+}
+
+// Empty deleters and allocators leave just the pointer next to the counts.
+static_assert(sizeof(ControlBlockWithPointer<test_object,
+                                             std::default_delete<test_object>,
+                                             atomic_policy>) ==
+              sizeof(ControlBlock<atomic_policy>) + sizeof(test_object*));
+static_assert(sizeof(ControlBlockWithPointer<test_object, empty_deleter,
+                                             atomic_policy>) ==
+              sizeof(ControlBlock<atomic_policy>) + sizeof(test_object*));
+static_assert(sizeof(ControlBlockWithPointer<int, std::default_delete<int[]>,
+                                             single_threaded_policy>) ==
+              sizeof(ControlBlock<single_threaded_policy>) + sizeof(int*));
+
+TEST(shared_ptr_testing, empty_deleter) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object> p(new test_object(42), empty_deleter());
+  EXPECT_EQ(42, *p);
+}
+
 TEST(shared_ptr_testing, aliasing_ctor) {
   test_object::no_new_instances_guard g;
   shared_ptr<test_object> p(new test_object(42));
@@ -262,3 +321,778 @@ TEST(shared_ptr_testing, conversions_inheritance) {
   shared_ptr<base> b = d;
   EXPECT_EQ(d.get(), b.get());
 }
+
+TEST(shared_ptr_testing, single_threaded_policy) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object, single_threaded_policy> p(new test_object(42));
+  weak_ptr<test_object, single_threaded_policy> w = p;
+  {
+    shared_ptr<test_object, single_threaded_policy> q = p;
+    EXPECT_EQ(2, p.use_count());
+    EXPECT_EQ(42, *q);
+  }
+  EXPECT_EQ(1, p.use_count());
+  p.reset();
+  EXPECT_FALSE(static_cast<bool>(w.lock()));
+}
+
+TEST(shared_ptr_testing, single_threaded_policy_make_shared) {
+  test_object::no_new_instances_guard g;
+  auto p = make_shared<test_object, single_threaded_policy>(42);
+  auto q = p;
+  EXPECT_EQ(2, q.use_count());
+  EXPECT_EQ(42, *q);
+}
+
+TEST(shared_ptr_testing, concurrent_copies) {
+  test_object::no_new_instances_guard g;
+  weak_ptr<test_object> w;
+  {
+    shared_ptr<test_object> p(new test_object(42));
+    w = p;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i != 4; ++i) {
+      threads.emplace_back([p] {
+        for (size_t j = 0; j != 10000; ++j) {
+          shared_ptr<test_object> q = p;
+          shared_ptr<test_object> r = std::move(q);
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    EXPECT_EQ(1, p.use_count());
+  }
+  EXPECT_FALSE(static_cast<bool>(w.lock()));
+}
+
+TEST(shared_ptr_testing, concurrent_lock_and_release) {
+  test_object::no_new_instances_guard g;
+  for (size_t i = 0; i != 100; ++i) {
+    shared_ptr<test_object> p(new test_object(42));
+    weak_ptr<test_object> w = p;
+    std::atomic<bool> expired{false};
+    std::vector<std::thread> threads;
+    for (size_t j = 0; j != 4; ++j) {
+      threads.emplace_back([w, &expired] {
+        while (!expired.load()) {
+          shared_ptr<test_object> q = w.lock();
+          if (!q) {
+            expired.store(true);
+          }
+        }
+      });
+    }
+    p.reset();
+    for (auto& t : threads) {
+      t.join();
+    }
+    EXPECT_FALSE(static_cast<bool>(w.lock()));
+  }
+}
+
+namespace {
+struct copy_counter {
+  static size_t copies;
+  static size_t moves;
+
+  copy_counter() = default;
+
+  copy_counter(const copy_counter&) {
+    ++copies;
+  }
+
+  copy_counter(copy_counter&&) noexcept {
+    ++moves;
+  }
+};
+
+size_t copy_counter::copies = 0;
+size_t copy_counter::moves = 0;
+
+struct counted_holder {
+  counted_holder(const copy_counter& a, copy_counter&& b)
+      : a(a), b(std::move(b)) {}
+
+  copy_counter a;
+  copy_counter b;
+};
+} // namespace
+
+TEST(shared_ptr_testing, make_shared_forwarding) {
+  copy_counter lvalue;
+  copy_counter::copies = 0;
+  copy_counter::moves = 0;
+  auto p = make_shared<counted_holder>(lvalue, copy_counter());
+  EXPECT_EQ(1, copy_counter::copies);
+  EXPECT_EQ(1, copy_counter::moves);
+}
+
+TEST(shared_ptr_testing, make_shared_move_only_argument) {
+  auto p = ::make_shared<std::unique_ptr<int>>(std::make_unique<int>(42));
+  EXPECT_EQ(42, **p);
+}
+
+TEST(shared_ptr_testing, make_shared_reference_argument) {
+  struct ref_holder {
+    explicit ref_holder(int& ref) : ref(ref) {}
+
+    int& ref;
+  };
+
+  int x = 42;
+  auto p = make_shared<ref_holder>(x);
+  p->ref = 43;
+  EXPECT_EQ(43, x);
+}
+
+namespace {
+struct allocation_stats {
+  size_t allocations = 0;
+  size_t deallocations = 0;
+  const void* last_block = nullptr;
+  size_t last_bytes = 0;
+};
+
+template <typename T>
+struct counting_allocator {
+  using value_type = T;
+
+  explicit counting_allocator(allocation_stats* stats) : stats(stats) {}
+
+  template <typename U>
+  counting_allocator(const counting_allocator<U>& other)
+      : stats(other.stats) {}
+
+  T* allocate(size_t n) {
+    ++stats->allocations;
+    T* block = std::allocator<T>().allocate(n);
+    stats->last_block = block;
+    stats->last_bytes = n * sizeof(T);
+    return block;
+  }
+
+  void deallocate(T* p, size_t n) {
+    ++stats->deallocations;
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  allocation_stats* stats;
+};
+
+template <typename T, typename U>
+bool operator==(const counting_allocator<T>& a,
+                const counting_allocator<U>& b) {
+  return a.stats == b.stats;
+}
+
+template <typename T, typename U>
+bool operator!=(const counting_allocator<T>& a,
+                const counting_allocator<U>& b) {
+  return !(a == b);
+}
+} // namespace
+
+TEST(shared_ptr_testing, allocate_shared) {
+  test_object::no_new_instances_guard g;
+  allocation_stats stats;
+  {
+    auto p = allocate_shared<test_object>(
+        counting_allocator<test_object>(&stats), 42);
+    EXPECT_EQ(42, *p);
+    EXPECT_EQ(1, stats.allocations);
+    weak_ptr<test_object> w = p;
+    p.reset();
+    EXPECT_EQ(0, stats.deallocations);
+  }
+  EXPECT_EQ(1, stats.deallocations);
+}
+
+TEST(shared_ptr_testing, ptr_ctor_allocator) {
+  test_object::no_new_instances_guard g;
+  allocation_stats stats;
+  bool deleted = false;
+  {
+    shared_ptr<test_object> p(new test_object(42),
+                              custom_deleter<test_object>(&deleted),
+                              counting_allocator<int>(&stats));
+    EXPECT_EQ(1, stats.allocations);
+    EXPECT_EQ(42, *p);
+  }
+  EXPECT_TRUE(deleted);
+  EXPECT_EQ(1, stats.deallocations);
+}
+
+TEST(shared_ptr_testing, reset_ptr_allocator) {
+  test_object::no_new_instances_guard g;
+  allocation_stats stats;
+  {
+    shared_ptr<test_object> p(new test_object(42));
+    p.reset(new test_object(43), std::default_delete<test_object>(),
+            counting_allocator<test_object>(&stats));
+    EXPECT_EQ(43, *p);
+    EXPECT_EQ(1, stats.allocations);
+  }
+  EXPECT_EQ(1, stats.deallocations);
+}
+
+TEST(shared_ptr_testing, allocate_shared_pmr) {
+  test_object::no_new_instances_guard g;
+  std::array<std::byte, 1024> buffer;
+  std::pmr::monotonic_buffer_resource resource(
+      buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+  {
+    auto p = allocate_shared<test_object>(
+        std::pmr::polymorphic_allocator<test_object>(&resource), 42);
+    auto q = p;
+    EXPECT_EQ(42, *q);
+  }
+}
+
+TEST(shared_ptr_testing, array_ptr_ctor) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object[]> p(new test_object[3]{1, 2, 3});
+  EXPECT_EQ(2, p[1]);
+  shared_ptr<test_object[]> q = p;
+  EXPECT_EQ(2, q.use_count());
+  q.reset(new test_object[2]{4, 5});
+  EXPECT_EQ(5, q[1]);
+}
+
+TEST(shared_ptr_testing, make_shared_array) {
+  auto p = make_shared<int[]>(5);
+  for (size_t i = 0; i != 5; ++i) {
+    EXPECT_EQ(0, p[i]);
+  }
+  p[4] = 42;
+  weak_ptr<int[]> w = p;
+  EXPECT_EQ(42, w.lock()[4]);
+}
+
+TEST(shared_ptr_testing, make_shared_array_value) {
+  test_object::no_new_instances_guard g;
+  {
+    auto p = make_shared<test_object[]>(3, test_object(42));
+    EXPECT_EQ(42, p[0]);
+    EXPECT_EQ(42, p[2]);
+  }
+}
+
+TEST(shared_ptr_testing, make_shared_array_alignment) {
+  struct alignas(64) aligned {
+    char c;
+  };
+  auto p = make_shared<aligned[]>(3);
+  EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(p.get()) % 64);
+}
+
+TEST(shared_ptr_testing, make_shared_array_empty) {
+  auto p = make_shared<int[]>(0);
+  EXPECT_EQ(1, p.use_count());
+}
+
+TEST(shared_ptr_testing, make_shared_array_too_long) {
+  EXPECT_THROW(make_shared<int[]>(SIZE_MAX / 4 + 2), std::bad_array_new_length);
+  EXPECT_THROW(make_shared<int[]>(SIZE_MAX), std::bad_array_new_length);
+}
+
+namespace {
+struct throwing_element {
+  throwing_element() {
+    if (++constructed == 3) {
+      throw std::runtime_error("third element");
+    }
+  }
+
+  ~throwing_element() {
+    ++destroyed;
+  }
+
+  static size_t constructed;
+  static size_t destroyed;
+};
+
+size_t throwing_element::constructed = 0;
+size_t throwing_element::destroyed = 0;
+} // namespace
+
+TEST(shared_ptr_testing, make_shared_array_throwing_element) {
+  EXPECT_THROW(make_shared<throwing_element[]>(5), std::runtime_error);
+  EXPECT_EQ(3, throwing_element::constructed);
+  EXPECT_EQ(2, throwing_element::destroyed);
+}
+
+TEST(shared_ptr_testing, allocate_shared_array) {
+  test_object::no_new_instances_guard g;
+  allocation_stats stats;
+  {
+    auto p = allocate_shared<test_object[]>(
+        counting_allocator<test_object>(&stats), 4, test_object(7));
+    EXPECT_EQ(7, p[3]);
+    EXPECT_EQ(1, stats.allocations);
+  }
+  EXPECT_EQ(1, stats.deallocations);
+}
+
+TEST(shared_ptr_testing, make_shared_for_overwrite) {
+  struct pod {
+    int values[4];
+  };
+  auto p = make_shared_for_overwrite<pod>();
+  p->values[0] = 42;
+  EXPECT_EQ(42, p->values[0]);
+  auto q = make_shared_for_overwrite<double[]>(1 << 16);
+  q[(1 << 16) - 1] = 1.5;
+  EXPECT_EQ(1.5, q[(1 << 16) - 1]);
+}
+
+namespace {
+struct large_payload {
+  static void* operator new(size_t size) {
+    ++allocations;
+    return ::operator new(size);
+  }
+
+  static void operator delete(void* ptr) {
+    ++deallocations;
+    ::operator delete(ptr);
+  }
+
+  char data[1 << 16];
+
+  static size_t allocations;
+  static size_t deallocations;
+};
+
+size_t large_payload::allocations = 0;
+size_t large_payload::deallocations = 0;
+} // namespace
+
+TEST(shared_ptr_testing, make_shared_split) {
+  large_payload::allocations = 0;
+  large_payload::deallocations = 0;
+  weak_ptr<large_payload> w;
+  {
+    auto p = make_shared_split<large_payload>();
+    w = p;
+    EXPECT_EQ(1, large_payload::allocations);
+    EXPECT_EQ(1, p.use_count());
+  }
+  EXPECT_EQ(1, large_payload::deallocations);
+  EXPECT_FALSE(static_cast<bool>(w.lock()));
+}
+
+TEST(shared_ptr_testing, make_shared_split_args) {
+  test_object::no_new_instances_guard g;
+  auto p = make_shared_split<test_object>(42);
+  shared_ptr<test_object> q = p;
+  EXPECT_EQ(42, *q);
+  EXPECT_EQ(2, q.use_count());
+}
+
+namespace {
+struct self_owning : enable_shared_from_this<self_owning> {
+  explicit self_owning(int value) : value(value) {}
+
+  int value;
+};
+
+struct derived_self_owning : self_owning {
+  using self_owning::self_owning;
+};
+} // namespace
+
+TEST(shared_ptr_testing, shared_from_this_ptr_ctor) {
+  shared_ptr<self_owning> p(new self_owning(42));
+  shared_ptr<self_owning> q = p->shared_from_this();
+  EXPECT_TRUE(p == q);
+  EXPECT_EQ(2, p.use_count());
+  EXPECT_EQ(42, q->value);
+}
+
+TEST(shared_ptr_testing, shared_from_this_make_shared) {
+  auto p = make_shared<self_owning>(42);
+  EXPECT_EQ(1, p.use_count());
+  auto q = p->shared_from_this();
+  EXPECT_TRUE(p == q);
+  EXPECT_EQ(2, p.use_count());
+
+  const self_owning& c = *p;
+  shared_ptr<const self_owning> r = c.shared_from_this();
+  EXPECT_EQ(3, p.use_count());
+}
+
+TEST(shared_ptr_testing, shared_from_this_reset) {
+  shared_ptr<self_owning> p;
+  p.reset(new self_owning(42));
+  EXPECT_EQ(1, p->weak_from_this().use_count());
+  EXPECT_TRUE(p->shared_from_this() == p);
+}
+
+TEST(shared_ptr_testing, shared_from_this_derived) {
+  shared_ptr<derived_self_owning> p(new derived_self_owning(42));
+  shared_ptr<self_owning> q = p->shared_from_this();
+  EXPECT_TRUE(p.get() == q.get());
+  EXPECT_EQ(2, p.use_count());
+}
+
+TEST(shared_ptr_testing, shared_from_this_not_owned) {
+  self_owning object(42);
+  EXPECT_THROW(object.shared_from_this(), std::bad_weak_ptr);
+  EXPECT_TRUE(object.weak_from_this().expired());
+}
+
+TEST(shared_ptr_testing, weak_from_this_expires) {
+  weak_ptr<self_owning> w;
+  {
+    auto p = make_shared<self_owning>(42);
+    w = p->weak_from_this();
+    EXPECT_FALSE(w.expired());
+  }
+  EXPECT_TRUE(w.expired());
+}
+
+TEST(shared_ptr_testing, shared_from_this_copy_is_not_owned) {
+  auto p = make_shared<self_owning>(42);
+  self_owning copy = *p;
+  EXPECT_THROW(copy.shared_from_this(), std::bad_weak_ptr);
+}
+
+TEST(shared_ptr_testing, weak_ptr_converting_ctor) {
+  struct base {};
+  struct derived : base {};
+
+  shared_ptr<derived> d(new derived());
+  weak_ptr<derived> wd = d;
+  weak_ptr<base> wb = wd;
+  EXPECT_EQ(d.get(), wb.lock().get());
+}
+
+TEST(shared_ptr_testing, aliasing_move_ctor) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object> p(new test_object(42));
+  test_object* raw = p.get();
+  int x;
+  shared_ptr<int> q(std::move(p), &x);
+  EXPECT_FALSE(static_cast<bool>(p));
+  EXPECT_EQ(1, q.use_count());
+  EXPECT_EQ(&x, q.get());
+  shared_ptr<test_object> r(std::move(q), raw);
+  EXPECT_EQ(42, *r);
+}
+
+TEST(shared_ptr_testing, converting_move_ctor) {
+  struct base {};
+  struct derived : base {};
+
+  shared_ptr<derived> d(new derived());
+  derived* raw = d.get();
+  shared_ptr<base> b = std::move(d);
+  EXPECT_FALSE(static_cast<bool>(d));
+  EXPECT_EQ(raw, b.get());
+  EXPECT_EQ(1, b.use_count());
+}
+
+TEST(shared_ptr_testing, converting_assignment) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object> p(new test_object(42));
+  shared_ptr<const test_object> c(new test_object(43));
+  c = p;
+  EXPECT_EQ(2, p.use_count());
+  EXPECT_EQ(42, *c);
+  c = std::move(p);
+  EXPECT_FALSE(static_cast<bool>(p));
+  EXPECT_EQ(1, c.use_count());
+}
+
+TEST(shared_ptr_testing, weak_ptr_move_ctor_steals) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object> p(new test_object(42));
+  weak_ptr<test_object> q = p;
+  weak_ptr<test_object> r(std::move(q));
+  EXPECT_TRUE(q.expired());
+  EXPECT_TRUE(r.lock() == p);
+  weak_ptr<const test_object> s(std::move(r));
+  EXPECT_TRUE(r.expired());
+  EXPECT_EQ(p.get(), s.lock().get());
+}
+
+namespace {
+struct virtual_base {
+  int value = 1;
+};
+
+struct virtually_derived : virtual virtual_base {
+  int other = 2;
+};
+} // namespace
+
+TEST(shared_ptr_testing, weak_ptr_to_virtual_base) {
+  static_assert(!std::is_constructible_v<weak_ptr<int>, weak_ptr<double>>);
+  static_assert(!std::is_constructible_v<weak_ptr<virtually_derived>,
+                                         weak_ptr<virtual_base>>);
+
+  shared_ptr<virtually_derived> p(new virtually_derived());
+  weak_ptr<virtually_derived> w = p;
+  weak_ptr<virtual_base> live = w;
+  EXPECT_EQ(static_cast<virtual_base*>(p.get()), live.lock().get());
+
+  p.reset();
+  weak_ptr<virtual_base> copied = w;
+  EXPECT_TRUE(copied.expired());
+  EXPECT_FALSE(copied.lock());
+  weak_ptr<virtual_base> moved = std::move(w);
+  EXPECT_TRUE(moved.expired());
+  EXPECT_TRUE(moved.owner_equal(live));
+}
+
+namespace {
+struct polymorphic_base {
+  virtual ~polymorphic_base() = default;
+};
+
+struct polymorphic_derived : polymorphic_base {
+  int value = 42;
+};
+
+struct polymorphic_other : polymorphic_base {};
+} // namespace
+
+TEST(shared_ptr_testing, static_pointer_cast) {
+  shared_ptr<polymorphic_base> b(new polymorphic_derived());
+  auto d = static_pointer_cast<polymorphic_derived>(b);
+  EXPECT_EQ(42, d->value);
+  EXPECT_EQ(2, b.use_count());
+  auto moved = static_pointer_cast<polymorphic_derived>(std::move(b));
+  EXPECT_FALSE(static_cast<bool>(b));
+  EXPECT_EQ(2, moved.use_count());
+}
+
+TEST(shared_ptr_testing, dynamic_pointer_cast) {
+  shared_ptr<polymorphic_base> b(new polymorphic_derived());
+  EXPECT_FALSE(static_cast<bool>(dynamic_pointer_cast<polymorphic_other>(b)));
+  EXPECT_FALSE(static_cast<bool>(
+      dynamic_pointer_cast<polymorphic_other>(std::move(b))));
+  EXPECT_EQ(1, b.use_count());
+  auto d = dynamic_pointer_cast<polymorphic_derived>(std::move(b));
+  EXPECT_FALSE(static_cast<bool>(b));
+  EXPECT_EQ(1, d.use_count());
+  EXPECT_EQ(42, d->value);
+}
+
+TEST(shared_ptr_testing, const_pointer_cast) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<const test_object> c(new test_object(42));
+  shared_ptr<test_object> p = const_pointer_cast<test_object>(c);
+  EXPECT_EQ(2, p.use_count());
+  shared_ptr<test_object> q = const_pointer_cast<test_object>(std::move(c));
+  EXPECT_FALSE(static_cast<bool>(c));
+  EXPECT_EQ(2, q.use_count());
+}
+
+TEST(shared_ptr_testing, make_shared_cache_aligned) {
+  test_object::no_new_instances_guard g;
+  allocation_stats stats;
+  {
+    auto p = allocate_shared<test_object>(
+        counting_allocator<test_object>(&stats), cache_aligned, 42);
+    EXPECT_EQ(42, *p);
+    EXPECT_EQ(1, stats.allocations);
+    auto block = reinterpret_cast<std::uintptr_t>(stats.last_block);
+    auto object = reinterpret_cast<std::uintptr_t>(p.get());
+    EXPECT_EQ(0, block % cache_line_size);
+    // The object starts on the first line after the block header.
+    size_t header = (sizeof(ControlBlock<atomic_policy>) + cache_line_size - 1) /
+                    cache_line_size * cache_line_size;
+    EXPECT_EQ(block + header, object);
+    EXPECT_LE(header + cache_line_size, stats.last_bytes);
+  }
+  EXPECT_EQ(1, stats.deallocations);
+
+  auto q = make_shared<test_object>(cache_aligned, 43);
+  EXPECT_EQ(43, *q);
+  EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(q.get()) % cache_line_size);
+  auto r = allocate_shared<int>(std::allocator<int>(), cache_aligned,
+                                for_overwrite_t());
+  *r = 1;
+  EXPECT_EQ(1, *r);
+}
+
+namespace {
+struct self_owner {
+  shared_ptr<self_owner> self;
+};
+} // namespace
+
+TEST(shared_ptr_testing, reset_handle_owned_by_its_object) {
+  test_object::no_new_instances_guard g;
+  auto p = make_shared<self_owner>();
+  p->self = p;
+  self_owner* raw = p.get();
+  p.reset();
+  raw->self.reset();
+}
+
+namespace {
+struct list_node {
+  explicit list_node(int value) : value(value) {}
+
+  test_object value;
+  shared_ptr<list_node> next;
+};
+
+shared_ptr<list_node> make_list(int length) {
+  shared_ptr<list_node> head;
+  for (int i = length; i != 0; --i) {
+    auto node = make_shared<list_node>(i);
+    node->next = std::move(head);
+    head = std::move(node);
+  }
+  return head;
+}
+} // namespace
+
+TEST(shared_ptr_testing, assign_handle_owned_by_released_object) {
+  test_object::no_new_instances_guard g;
+  auto head = make_list(3);
+  head = std::move(head->next);
+  EXPECT_EQ(2, head->value);
+  EXPECT_EQ(1, head.use_count());
+
+  // Walking the list drops each node behind the cursor.
+  auto cursor = std::move(head);
+  cursor = cursor->next;
+  EXPECT_EQ(3, cursor->value);
+  cursor = cursor->next;
+  EXPECT_FALSE(cursor);
+}
+
+static_assert(is_trivially_relocatable_v<shared_ptr<int>>);
+static_assert(is_trivially_relocatable_v<weak_ptr<int[]>>);
+static_assert(is_trivially_relocatable_v<int*>);
+static_assert(!is_trivially_relocatable_v<std::vector<int>>);
+
+TEST(shared_ptr_testing, uninitialized_relocate) {
+  test_object::no_new_instances_guard g;
+  auto source = make_shared<test_object>(42);
+  weak_ptr<test_object> weak = source;
+  using P = shared_ptr<test_object>;
+  alignas(P) unsigned char from[3 * sizeof(P)];
+  alignas(P) unsigned char to[3 * sizeof(P)];
+  auto* first = reinterpret_cast<P*>(from);
+  auto* dest = reinterpret_cast<P*>(to);
+  for (int i = 0; i != 3; ++i) {
+    ::new (static_cast<void*>(first + i)) P(source);
+  }
+  EXPECT_EQ(4, source.use_count());
+
+  auto* end = uninitialized_relocate(first, first + 3, dest);
+  EXPECT_EQ(dest + 3, end);
+  EXPECT_EQ(4, source.use_count());
+  EXPECT_EQ(42, *dest[2]);
+  std::destroy(dest, end);
+  EXPECT_EQ(1, source.use_count());
+  source.reset();
+  EXPECT_TRUE(weak.expired());
+
+  // Other types are moved and destroyed one by one.
+  using V = std::vector<int>;
+  alignas(V) unsigned char vectors_from[2 * sizeof(V)];
+  alignas(V) unsigned char vectors_to[2 * sizeof(V)];
+  auto* vectors = reinterpret_cast<V*>(vectors_from);
+  ::new (static_cast<void*>(vectors)) V{1, 2};
+  ::new (static_cast<void*>(vectors + 1)) V{3};
+  auto* moved = reinterpret_cast<V*>(vectors_to);
+  uninitialized_relocate(vectors, vectors + 2, moved);
+  EXPECT_EQ(2, moved[0].size());
+  EXPECT_EQ(3, moved[1][0]);
+  std::destroy(moved, moved + 2);
+}
+
+TEST(shared_ptr_testing, owner_ordering) {
+  test_object::no_new_instances_guard g;
+  auto a = make_shared<test_object>(1);
+  auto b = make_shared<test_object>(2);
+  int x;
+  shared_ptr<int> alias(a, &x);
+  weak_ptr<test_object> weak = a;
+
+  EXPECT_FALSE(a.owner_before(alias));
+  EXPECT_FALSE(alias.owner_before(a));
+  EXPECT_TRUE(a.owner_equal(alias));
+  EXPECT_TRUE(weak.owner_equal(alias));
+  EXPECT_FALSE(a.owner_equal(b));
+  EXPECT_NE(a.owner_before(b), b.owner_before(a));
+  EXPECT_EQ(a.owner_before(b), weak.owner_before(b));
+  EXPECT_EQ(a.owner_hash(), alias.owner_hash());
+  EXPECT_EQ(a.owner_hash(), weak.owner_hash());
+  EXPECT_EQ(std::hash<shared_ptr<test_object>>()(a),
+            std::hash<weak_ptr<test_object>>()(weak));
+
+  const shared_ptr<test_object> c = a;
+  EXPECT_TRUE(c == a);
+  EXPECT_FALSE(c != a);
+  EXPECT_TRUE(c != b);
+  EXPECT_TRUE(weak == weak_ptr<test_object>(c));
+  EXPECT_TRUE(weak != weak_ptr<test_object>(b));
+}
+
+TEST(shared_ptr_testing, owner_keyed_containers) {
+  test_object::no_new_instances_guard g;
+  auto a = make_shared<test_object>(1);
+  auto b = make_shared<test_object>(2);
+
+  std::map<weak_ptr<test_object>, int, owner_less<>> ordered;
+  ordered[a] = 1;
+  ordered[b] = 2;
+  EXPECT_EQ(1, ordered.find(a)->second);
+  EXPECT_EQ(2, ordered.find(b)->second);
+
+  std::unordered_map<weak_ptr<test_object>, int, owner_hash, owner_equal>
+      owners;
+  owners[a] = 1;
+  owners[b] = 2;
+  std::unordered_set<shared_ptr<test_object>> handles{a, b, a};
+  EXPECT_EQ(2, handles.size());
+
+  // Expired keys keep their place and can still be found and erased.
+  weak_ptr<test_object> expired = b;
+  handles.erase(b);
+  b.reset();
+  EXPECT_TRUE(expired.expired());
+  EXPECT_EQ(2, ordered.find(expired)->second);
+  EXPECT_EQ(2, owners.at(expired));
+  EXPECT_EQ(1, owners.erase(expired));
+  EXPECT_EQ(1, owners.at(a));
+}
+
+// Empty handles need no dynamic initialization, so globals like these
+// are set up before any constructor runs.
+#ifdef __cpp_constinit
+constinit shared_ptr<test_object> global_null_shared;
+constinit shared_ptr<test_object> global_nullptr_shared(nullptr);
+constinit weak_ptr<test_object> global_null_weak;
+#else
+shared_ptr<test_object> global_null_shared;
+shared_ptr<test_object> global_nullptr_shared(nullptr);
+weak_ptr<test_object> global_null_weak;
+#endif
+
+static_assert(std::is_nothrow_default_constructible_v<shared_ptr<int>>);
+static_assert(std::is_nothrow_default_constructible_v<weak_ptr<int>>);
+static_assert(std::is_nothrow_destructible_v<shared_ptr<int>>);
+static_assert(noexcept(std::declval<shared_ptr<int>&>().reset()));
+static_assert(noexcept(std::declval<shared_ptr<int>&>().get()));
+static_assert(noexcept(std::declval<weak_ptr<int>&>().lock()));
+static_assert(noexcept(shared_ptr<int>(std::declval<shared_ptr<int>&>(),
+                                       nullptr)));
+
+TEST(shared_ptr_testing, constant_initialized_globals) {
+  EXPECT_FALSE(global_null_shared);
+  EXPECT_EQ(nullptr, global_nullptr_shared.get());
+  EXPECT_TRUE(global_null_weak.expired());
+  global_null_shared = make_shared<test_object>(42);
+  EXPECT_EQ(42, *global_null_shared);
+  global_null_shared.reset();
+}
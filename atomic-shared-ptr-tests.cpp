@@ -0,0 +1,145 @@
+#include "atomic-shared-ptr.h"
+#include "tests-extra/test-object.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+TEST(atomic_shared_ptr_testing, default_ctor) {
+  atomic_shared_ptr<test_object> a;
+  EXPECT_FALSE(static_cast<bool>(a.load()));
+  EXPECT_TRUE(a.is_lock_free());
+}
+
+TEST(atomic_shared_ptr_testing, load_store) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object> p(new test_object(42));
+  atomic_shared_ptr<test_object> a(p);
+  EXPECT_EQ(2, p.use_count());
+  shared_ptr<test_object> q = a.load();
+  EXPECT_TRUE(p == q);
+  EXPECT_EQ(3, p.use_count());
+
+  a.store(shared_ptr<test_object>(new test_object(43)));
+  EXPECT_EQ(2, p.use_count());
+  EXPECT_EQ(43, *a.load());
+}
+
+TEST(atomic_shared_ptr_testing, exchange) {
+  test_object::no_new_instances_guard g;
+  atomic_shared_ptr<test_object> a(shared_ptr<test_object>(new test_object(42)));
+  shared_ptr<test_object> old = a.exchange(make_shared<test_object>(43));
+  EXPECT_EQ(42, *old);
+  EXPECT_EQ(1, old.use_count());
+  EXPECT_EQ(43, *a.load());
+  old = a.exchange(shared_ptr<test_object>());
+  EXPECT_EQ(43, *old);
+  EXPECT_FALSE(static_cast<bool>(a.load()));
+}
+
+TEST(atomic_shared_ptr_testing, compare_exchange) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object> p(new test_object(42));
+  shared_ptr<test_object> q(new test_object(43));
+  atomic_shared_ptr<test_object> a(p);
+
+  shared_ptr<test_object> expected = q;
+  EXPECT_FALSE(a.compare_exchange_strong(expected, q));
+  EXPECT_TRUE(expected == p);
+  EXPECT_TRUE(a.compare_exchange_strong(expected, q));
+  EXPECT_TRUE(a.load() == q);
+  EXPECT_EQ(2, p.use_count());
+
+  shared_ptr<test_object> empty;
+  EXPECT_FALSE(a.compare_exchange_weak(empty, p));
+  EXPECT_TRUE(empty == q);
+}
+
+TEST(atomic_shared_ptr_testing, compare_exchange_empty) {
+  test_object::no_new_instances_guard g;
+  atomic_shared_ptr<test_object> a;
+  shared_ptr<test_object> expected;
+  EXPECT_TRUE(a.compare_exchange_strong(expected,
+                                        make_shared<test_object>(42)));
+  EXPECT_EQ(42, *a.load());
+}
+
+TEST(atomic_shared_ptr_testing, std_atomic) {
+  test_object::no_new_instances_guard g;
+  std::atomic<shared_ptr<test_object>> a;
+  a = make_shared<test_object>(42);
+  shared_ptr<test_object> p = a;
+  EXPECT_EQ(42, *p);
+}
+
+TEST(atomic_shared_ptr_testing, concurrent_load_and_store) {
+  atomic_shared_ptr<int> a(make_shared<int>(0));
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i != 4; ++i) {
+    readers.emplace_back([&] {
+      int last = 0;
+      while (!done.load()) {
+        shared_ptr<int> p = a.load();
+        EXPECT_LE(last, *p);
+        last = *p;
+      }
+    });
+  }
+  for (int i = 1; i != 10000; ++i) {
+    a.store(make_shared<int>(i));
+  }
+  done.store(true);
+  for (auto& t : readers) {
+    t.join();
+  }
+  EXPECT_EQ(9999, *a.load());
+}
+
+TEST(atomic_shared_ptr_testing, pin) {
+  atomic_shared_ptr<int> a;
+  EXPECT_FALSE(a.pin());
+
+  a.store(make_shared<int>(1));
+  shared_ptr<int> kept = a.load();
+  weak_ptr<int> w = kept;
+  kept.reset();
+  {
+    auto guard = a.pin();
+    ASSERT_TRUE(guard);
+    a.store(make_shared<int>(2));
+    // The replaced value outlives the store while it is pinned.
+    EXPECT_FALSE(w.expired());
+    EXPECT_EQ(1, *guard);
+    shared_ptr<int> promoted = guard.to_shared();
+    EXPECT_EQ(2, promoted.use_count());
+  }
+  hazard_pointers::reclaim();
+  EXPECT_TRUE(w.expired());
+  EXPECT_EQ(2, *a.pin());
+}
+
+TEST(atomic_shared_ptr_testing, concurrent_pin_and_store) {
+  atomic_shared_ptr<int> a(make_shared<int>(0));
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i != 4; ++i) {
+    readers.emplace_back([&] {
+      int last = 0;
+      while (!done.load()) {
+        auto guard = a.pin();
+        EXPECT_LE(last, *guard);
+        last = *guard;
+      }
+    });
+  }
+  for (int i = 1; i != 10000; ++i) {
+    a.store(make_shared<int>(i));
+  }
+  done.store(true);
+  for (auto& t : readers) {
+    t.join();
+  }
+  hazard_pointers::reclaim();
+  EXPECT_EQ(0, hazard_pointers::deferred_size());
+  EXPECT_EQ(9999, *a.pin());
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+#include "hazard-pointers.h"
+#include "shared-ptr.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free atomic holder of a shared_ptr<T> using a split reference count.
+//
+// The stored value lives in a node, and the atomic word packs the node
+// address with a 16-bit local count in the upper bits. A reader borrows the
+// node by incrementing the local count, copies the shared_ptr out of it and
+// then gives the borrow back. If the node was swapped out in the meantime,
+// the writer has moved the local count into the node's own count, and the
+// reader settles its borrow there instead. Readers never block.
+//
+// pin() reads without touching any shared count: a snapshot_guard keeps
+// the node alive with a hazard pointer, so nodes are freed through
+// hazard_pointers::retire().
+template <typename T>
+class snapshot_guard;
+
+template <typename T>
+class atomic_shared_ptr {
+  static_assert(sizeof(std::uintptr_t) == 8,
+                "atomic_shared_ptr packs the local count into pointer bits");
+
+  friend class snapshot_guard<T>;
+
+public:
+  constexpr atomic_shared_ptr() noexcept = default;
+
+  atomic_shared_ptr(shared_ptr<T> desired)
+      : word(pack(make_node(std::move(desired)))) {}
+
+  atomic_shared_ptr(const atomic_shared_ptr&) = delete;
+  atomic_shared_ptr& operator=(const atomic_shared_ptr&) = delete;
+
+  atomic_shared_ptr& operator=(shared_ptr<T> desired) {
+    store(std::move(desired));
+    return *this;
+  }
+
+  operator shared_ptr<T>() const {
+    return load();
+  }
+
+  bool is_lock_free() const noexcept {
+    return word.is_lock_free();
+  }
+
+  shared_ptr<T> load() const {
+    node* n = acquire();
+    if (!n) {
+      return shared_ptr<T>();
+    }
+    shared_ptr<T> result = n->value;
+    release(n);
+    return result;
+  }
+
+  // Pins the current value for the scope of the returned guard.
+  snapshot_guard<T> pin() const noexcept;
+
+  void store(shared_ptr<T> desired) {
+    exchange(std::move(desired));
+  }
+
+  shared_ptr<T> exchange(shared_ptr<T> desired) {
+    std::uintptr_t old =
+        word.exchange(pack(make_node(std::move(desired))),
+                      std::memory_order_seq_cst);
+    node* n = unpack(old);
+    if (!n) {
+      return shared_ptr<T>();
+    }
+    // Readers may still be copying n->value, so it is copied, not moved.
+    shared_ptr<T> result = n->value;
+    retire(n, local_count(old));
+    return result;
+  }
+
+  bool compare_exchange_strong(shared_ptr<T>& expected,
+                               shared_ptr<T> desired) {
+    node* desired_node = make_node(std::move(desired));
+    while (true) {
+      node* n = acquire();
+      if (!holds(n, expected)) {
+        expected = n ? n->value : shared_ptr<T>();
+        if (n) {
+          release(n);
+        }
+        delete desired_node;
+        return false;
+      }
+      if (!n) {
+        std::uintptr_t current = 0;
+        if (word.compare_exchange_strong(current, pack(desired_node),
+                                         std::memory_order_acq_rel)) {
+          return true;
+        }
+        continue;
+      }
+      std::uintptr_t current = word.load(std::memory_order_relaxed);
+      while (unpack(current) == n) {
+        if (word.compare_exchange_weak(current, pack(desired_node),
+                                       std::memory_order_seq_cst)) {
+          // Our own borrow moved into the node count with the rest.
+          retire(n, local_count(current));
+          release(n);
+          return true;
+        }
+      }
+      release(n);
+    }
+  }
+
+  // Never fails spuriously.
+  bool compare_exchange_weak(shared_ptr<T>& expected, shared_ptr<T> desired) {
+    return compare_exchange_strong(expected, std::move(desired));
+  }
+
+  ~atomic_shared_ptr() {
+    std::uintptr_t current = word.load(std::memory_order_acquire);
+    retire(unpack(current), local_count(current));
+  }
+
+private:
+  struct node {
+    explicit node(shared_ptr<T> value) : value(std::move(value)) {}
+
+    shared_ptr<T> value;
+    // Borrows transferred by the writer minus borrows already given back.
+    std::atomic<std::ptrdiff_t> count{0};
+  };
+
+  static constexpr unsigned local_shift = 48;
+  static constexpr std::uintptr_t one_local = std::uintptr_t(1) << local_shift;
+  static constexpr std::uintptr_t pointer_mask = one_local - 1;
+
+  static node* make_node(shared_ptr<T> value) {
+    if (!value.control_block_ptr && !value.object_ptr) {
+      return nullptr;
+    }
+    return new node(std::move(value));
+  }
+
+  static std::uintptr_t pack(node* n) noexcept {
+    return reinterpret_cast<std::uintptr_t>(n);
+  }
+
+  static node* unpack(std::uintptr_t w) noexcept {
+    return reinterpret_cast<node*>(w & pointer_mask);
+  }
+
+  static std::ptrdiff_t local_count(std::uintptr_t w) noexcept {
+    return static_cast<std::ptrdiff_t>(w >> local_shift);
+  }
+
+  static bool holds(node* n, const shared_ptr<T>& expected) noexcept {
+    if (!n) {
+      return !expected.control_block_ptr && !expected.object_ptr;
+    }
+    return n->value.control_block_ptr == expected.control_block_ptr &&
+           n->value.object_ptr == expected.object_ptr;
+  }
+
+  node* acquire() const noexcept {
+    std::uintptr_t current = word.load(std::memory_order_relaxed);
+    while (unpack(current) &&
+           !word.compare_exchange_weak(current, current + one_local,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+    }
+    return unpack(current);
+  }
+
+  // Gives back a borrow taken by acquire(). While the node is still
+  // installed (nodes are never reinstalled, and this one cannot be freed
+  // before we give it back), the borrow is part of the local count.
+  void release(node* n) const noexcept {
+    std::uintptr_t current = word.load(std::memory_order_relaxed);
+    while (unpack(current) == n) {
+      if (word.compare_exchange_weak(current, current - one_local,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+        return;
+      }
+    }
+    if (n->count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      hazard_pointers::retire(n);
+    }
+  }
+
+  // Called once a node has been swapped out with `borrowed` readers still
+  // holding it.
+  static void retire(node* n, std::ptrdiff_t borrowed) noexcept {
+    if (n && n->count.fetch_add(borrowed, std::memory_order_acq_rel) +
+                     borrowed ==
+                 0) {
+      hazard_pointers::retire(n);
+    }
+  }
+
+  mutable std::atomic<std::uintptr_t> word{0};
+};
+
+// Scoped read of an atomic_shared_ptr that takes no reference. The value
+// stays alive until the guard goes away, even if it is replaced meanwhile.
+template <typename T>
+class snapshot_guard {
+public:
+  explicit snapshot_guard(const atomic_shared_ptr<T>& source) noexcept
+      : pinned(hazard.protect([&source] {
+          return atomic_shared_ptr<T>::unpack(
+              source.word.load(std::memory_order_seq_cst));
+        })) {}
+
+  snapshot_guard(const snapshot_guard&) = delete;
+  snapshot_guard& operator=(const snapshot_guard&) = delete;
+
+  T* get() const noexcept {
+    return pinned ? pinned->value.get() : nullptr;
+  }
+
+  T& operator*() const noexcept {
+    return *get();
+  }
+
+  T* operator->() const noexcept {
+    return get();
+  }
+
+  explicit operator bool() const noexcept {
+    return get();
+  }
+
+  // Takes a real reference to the pinned value.
+  shared_ptr<T> to_shared() const {
+    return pinned ? pinned->value : shared_ptr<T>();
+  }
+
+private:
+  using node = typename atomic_shared_ptr<T>::node;
+
+  hazard_pointers::hazard hazard;
+  node* pinned;
+};
+
+template <typename T>
+snapshot_guard<T> atomic_shared_ptr<T>::pin() const noexcept {
+  return snapshot_guard<T>(*this);
+}
+
+namespace std {
+template <typename T>
+struct atomic<::shared_ptr<T>> : atomic_shared_ptr<T> {
+  using atomic_shared_ptr<T>::atomic_shared_ptr;
+  using atomic_shared_ptr<T>::operator=;
+};
+} // namespace std
@@ -0,0 +1,115 @@
+#include "control-block-pool.h"
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+namespace {
+
+// Single-threaded free list of equally sized blocks, enough to show what
+// taking malloc off the control block path is worth.
+template <typename T>
+struct pool_allocator {
+  using value_type = T;
+
+  pool_allocator() = default;
+
+  template <typename U>
+  pool_allocator(const pool_allocator<U>&) {}
+
+  T* allocate(size_t n) {
+    if (n != 1 || !free_list) {
+      return std::allocator<T>().allocate(n);
+    }
+    node* head = free_list;
+    free_list = head->next;
+    return reinterpret_cast<T*>(head);
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (n != 1) {
+      std::allocator<T>().deallocate(p, n);
+      return;
+    }
+    auto* head = reinterpret_cast<node*>(p);
+    head->next = free_list;
+    free_list = head;
+  }
+
+  template <typename U>
+  bool operator==(const pool_allocator<U>&) const noexcept {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const pool_allocator<U>&) const noexcept {
+    return false;
+  }
+
+private:
+  struct node {
+    node* next;
+  };
+  static_assert(sizeof(T) >= sizeof(node), "block too small for free list");
+
+  static inline node* free_list = nullptr;
+};
+
+struct record {
+  long fields[4];
+};
+
+void BM_churn_make_shared(benchmark::State& state) {
+  std::vector<shared_ptr<record>> live(state.range(0));
+  for (auto _ : state) {
+    for (auto& p : live) {
+      p = make_shared<record>();
+    }
+  }
+}
+
+void BM_churn_allocate_shared_pool(benchmark::State& state) {
+  std::vector<shared_ptr<record>> live(state.range(0));
+  pool_allocator<record> alloc;
+  for (auto _ : state) {
+    for (auto& p : live) {
+      p = allocate_shared<record>(alloc);
+    }
+  }
+}
+
+void BM_churn_ptr_ctor(benchmark::State& state) {
+  std::vector<shared_ptr<record>> live(state.range(0));
+  for (auto _ : state) {
+    for (auto& p : live) {
+      p.reset(new record());
+    }
+  }
+}
+
+void BM_churn_ptr_ctor_pool(benchmark::State& state) {
+  std::vector<shared_ptr<record>> live(state.range(0));
+  pool_allocator<record> alloc;
+  for (auto _ : state) {
+    for (auto& p : live) {
+      p.reset(new record(), std::default_delete<record>(), alloc);
+    }
+  }
+}
+
+void BM_churn_ptr_ctor_builtin_pool(benchmark::State& state) {
+  std::vector<shared_ptr<record>> live(state.range(0));
+  control_block_pool_allocator<record> alloc;
+  for (auto _ : state) {
+    for (auto& p : live) {
+      p.reset(new record(), std::default_delete<record>(), alloc);
+    }
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_churn_make_shared)->Range(1, 1 << 12);
+BENCHMARK(BM_churn_allocate_shared_pool)->Range(1, 1 << 12);
+BENCHMARK(BM_churn_ptr_ctor)->Range(1, 1 << 12);
+BENCHMARK(BM_churn_ptr_ctor_pool)->Range(1, 1 << 12);
+BENCHMARK(BM_churn_ptr_ctor_builtin_pool)->Range(1, 1 << 12);
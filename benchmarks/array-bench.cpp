@@ -0,0 +1,32 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+// The old way: a separate array allocation and control block.
+void BM_array_new_with_deleter(benchmark::State& state) {
+  for (auto _ : state) {
+    shared_ptr<double[]> buffer(new double[state.range(0)]());
+    benchmark::DoNotOptimize(buffer.get());
+  }
+}
+
+void BM_make_shared_array(benchmark::State& state) {
+  for (auto _ : state) {
+    auto buffer = make_shared<double[]>(state.range(0));
+    benchmark::DoNotOptimize(buffer.get());
+  }
+}
+
+void BM_make_shared_array_for_overwrite(benchmark::State& state) {
+  for (auto _ : state) {
+    auto buffer = make_shared_for_overwrite<double[]>(state.range(0));
+    benchmark::DoNotOptimize(buffer.get());
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_array_new_with_deleter)->Range(1 << 4, 1 << 20);
+BENCHMARK(BM_make_shared_array)->Range(1 << 4, 1 << 20);
+BENCHMARK(BM_make_shared_array_for_overwrite)->Range(1 << 4, 1 << 20);
@@ -0,0 +1,67 @@
+#include "atomic-shared-ptr.h"
+#include <benchmark/benchmark.h>
+#include <mutex>
+
+namespace {
+
+struct config {
+  int version;
+};
+
+// Thread 0 also publishes a new snapshot every writer_period reads.
+constexpr size_t writer_period = 1024;
+
+atomic_shared_ptr<config> published(make_shared<config>(config{0}));
+
+std::mutex baseline_mutex;
+shared_ptr<config> baseline(make_shared<config>(config{0}));
+
+void BM_atomic_shared_ptr_load(benchmark::State& state) {
+  size_t reads = 0;
+  for (auto _ : state) {
+    shared_ptr<config> snapshot = published.load();
+    benchmark::DoNotOptimize(snapshot->version);
+    if (state.thread_index() == 0 && ++reads % writer_period == 0) {
+      published.store(make_shared<config>(config{snapshot->version + 1}));
+    }
+  }
+}
+
+// Reads through a hazard pointer, without touching any shared count.
+void BM_atomic_shared_ptr_pin(benchmark::State& state) {
+  size_t reads = 0;
+  for (auto _ : state) {
+    int version;
+    {
+      auto snapshot = published.pin();
+      version = snapshot->version;
+      benchmark::DoNotOptimize(version);
+    }
+    if (state.thread_index() == 0 && ++reads % writer_period == 0) {
+      published.store(make_shared<config>(config{version + 1}));
+    }
+  }
+}
+
+void BM_mutex_shared_ptr_load(benchmark::State& state) {
+  size_t reads = 0;
+  for (auto _ : state) {
+    shared_ptr<config> snapshot;
+    {
+      std::lock_guard<std::mutex> lock(baseline_mutex);
+      snapshot = baseline;
+    }
+    benchmark::DoNotOptimize(snapshot->version);
+    if (state.thread_index() == 0 && ++reads % writer_period == 0) {
+      auto next = make_shared<config>(config{snapshot->version + 1});
+      std::lock_guard<std::mutex> lock(baseline_mutex);
+      baseline = next;
+    }
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_atomic_shared_ptr_load)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_atomic_shared_ptr_pin)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_mutex_shared_ptr_load)->ThreadRange(1, 64)->UseRealTime();
@@ -0,0 +1,46 @@
+#include "shared-batch.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+namespace {
+
+struct record {
+  long id = 0;
+  double value = 1.0;
+};
+
+// Creates, sums up and releases range(0) records one make_shared at a
+// time.
+void BM_make_shared_each(benchmark::State& state) {
+  for (auto _ : state) {
+    std::vector<shared_ptr<record>> records;
+    records.reserve(state.range(0));
+    for (long i = 0; i != state.range(0); ++i) {
+      records.push_back(make_shared<record>());
+    }
+    double sum = 0;
+    for (auto& r : records) {
+      sum += r->value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The same with all records in one arena.
+void BM_make_shared_batch(benchmark::State& state) {
+  for (auto _ : state) {
+    auto records = make_shared_batch<record>(state.range(0));
+    double sum = 0;
+    for (auto& r : records) {
+      sum += r->value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK(BM_make_shared_each)->Range(8, 1 << 16);
+BENCHMARK(BM_make_shared_batch)->Range(8, 1 << 16);
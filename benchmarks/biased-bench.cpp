@@ -0,0 +1,65 @@
+#include "biased-policy.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+// Each thread copies handles to an object it created itself, which is the
+// case biased counting is built for.
+template <typename Policy>
+void BM_owner_copies(benchmark::State& state) {
+  shared_ptr<int, Policy> source(new int(42));
+  for (auto _ : state) {
+    shared_ptr<int, Policy> copy = source;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+
+template <typename Policy>
+shared_ptr<int, Policy>& shared_source() {
+  static shared_ptr<int, Policy> source(new int(42));
+  return source;
+}
+
+// Mostly private copies, and every sixteenth copy of an object created by
+// another thread, so biased counting also takes its atomic path.
+template <typename Policy>
+void BM_mixed_copies(benchmark::State& state) {
+  shared_ptr<int, Policy> local(new int(42));
+  const shared_ptr<int, Policy>& shared = shared_source<Policy>();
+  unsigned i = 0;
+  for (auto _ : state) {
+    shared_ptr<int, Policy> copy = (++i & 15) == 0 ? shared : local;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+
+// Only copies of an object created by another thread.
+template <typename Policy>
+void BM_foreign_copies(benchmark::State& state) {
+  const shared_ptr<int, Policy>& shared = shared_source<Policy>();
+  for (auto _ : state) {
+    shared_ptr<int, Policy> copy = shared;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_owner_copies, atomic_policy)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_owner_copies, biased_policy)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_mixed_copies, atomic_policy)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_mixed_copies, biased_policy)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_foreign_copies, atomic_policy)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_foreign_copies, biased_policy)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
@@ -0,0 +1,60 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Fills a vector with copies of one handle and drops them again: one
+// increment and one decrement of the control block per element.
+template <typename Policy>
+void BM_copy_destroy(benchmark::State& state) {
+  shared_ptr<int, Policy> source(new int(42));
+  std::vector<shared_ptr<int, Policy>> copies;
+  copies.reserve(state.range(0));
+  for (auto _ : state) {
+    for (int64_t i = 0; i != state.range(0); ++i) {
+      copies.push_back(source);
+    }
+    copies.clear();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Moves range(0) handles to new storage, as a vector does when it grows:
+// with uninitialized_relocate() or by move construction and destruction.
+template <bool Trivial>
+void BM_relocate(benchmark::State& state) {
+  using P = shared_ptr<int>;
+  auto source = make_shared<int>(42);
+  size_t n = state.range(0);
+  std::allocator<P> alloc;
+  P* from = alloc.allocate(n);
+  P* to = alloc.allocate(n);
+  std::uninitialized_fill_n(from, n, source);
+  for (auto _ : state) {
+    if (Trivial) {
+      uninitialized_relocate(from, from + n, to);
+    } else {
+      for (size_t i = 0; i != n; ++i) {
+        ::new (static_cast<void*>(to + i)) P(std::move(from[i]));
+        from[i].~P();
+      }
+    }
+    std::swap(from, to);
+    benchmark::ClobberMemory();
+  }
+  std::destroy_n(from, n);
+  alloc.deallocate(from, n);
+  alloc.deallocate(to, n);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_copy_destroy, atomic_policy)->Range(8, 1 << 12);
+BENCHMARK_TEMPLATE(BM_copy_destroy, single_threaded_policy)->Range(8, 1 << 12);
+BENCHMARK_TEMPLATE(BM_relocate, true)->Range(8, 1 << 12);
+BENCHMARK_TEMPLATE(BM_relocate, false)->Range(8, 1 << 12);
@@ -0,0 +1,48 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+#include <atomic>
+
+namespace {
+
+struct counter_object {
+  std::atomic<long> value{0};
+};
+
+// Thread 0 keeps writing to the object while the other threads copy
+// handles to it. With the default layout the counters and the object
+// share a cache line, and both sides keep stealing it from each other.
+template <bool Aligned>
+void BM_copy_while_writing(benchmark::State& state) {
+  static shared_ptr<counter_object> shared;
+  if (state.thread_index() == 0) {
+    if constexpr (Aligned) {
+      shared = make_shared<counter_object>(cache_aligned);
+    } else {
+      shared = make_shared<counter_object>();
+    }
+  }
+  // All threads wait for each other before the first iteration, which
+  // also publishes the handle set up by thread 0.
+  for (auto _ : state) {
+    if (state.thread_index() == 0) {
+      shared->value.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      shared_ptr<counter_object> copy = shared;
+      benchmark::DoNotOptimize(copy);
+    }
+  }
+  if (state.thread_index() == 0) {
+    state.counters["writes"] =
+        benchmark::Counter(static_cast<double>(shared->value.load()),
+                           benchmark::Counter::kIsRate);
+  }
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_copy_while_writing, false)
+    ->ThreadRange(2, 16)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_copy_while_writing, true)
+    ->ThreadRange(2, 16)
+    ->UseRealTime();
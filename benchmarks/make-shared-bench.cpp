@@ -0,0 +1,64 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+namespace {
+
+// Heavy payload that counts how it is constructed, the same way
+// tests-extra/test-object tracks its instances.
+struct payload {
+  static size_t copies;
+  static size_t moves;
+
+  explicit payload(size_t size) : data(size) {}
+
+  payload(const payload& other) : data(other.data) {
+    ++copies;
+  }
+
+  payload(payload&& other) noexcept : data(std::move(other.data)) {
+    ++moves;
+  }
+
+  std::vector<char> data;
+};
+
+size_t payload::copies = 0;
+size_t payload::moves = 0;
+
+struct holder {
+  explicit holder(const payload& p) : p(p) {}
+  explicit holder(payload&& p) : p(std::move(p)) {}
+
+  payload p;
+};
+
+void report(benchmark::State& state) {
+  auto iterations = static_cast<double>(state.iterations());
+  state.counters["copies"] = static_cast<double>(payload::copies) / iterations;
+  state.counters["moves"] = static_cast<double>(payload::moves) / iterations;
+}
+
+void BM_make_shared_rvalue(benchmark::State& state) {
+  payload::copies = payload::moves = 0;
+  for (auto _ : state) {
+    auto p = make_shared<holder>(payload(state.range(0)));
+    benchmark::DoNotOptimize(p);
+  }
+  report(state);
+}
+
+void BM_make_shared_lvalue(benchmark::State& state) {
+  payload source(state.range(0));
+  payload::copies = payload::moves = 0;
+  for (auto _ : state) {
+    auto p = make_shared<holder>(source);
+    benchmark::DoNotOptimize(p);
+  }
+  report(state);
+}
+
+} // namespace
+
+BENCHMARK(BM_make_shared_rvalue)->Range(64, 1 << 20);
+BENCHMARK(BM_make_shared_lvalue)->Range(64, 1 << 20);
@@ -0,0 +1,61 @@
+#include "deferred-reclaim.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+struct tree_node {
+  int value;
+  shared_ptr<tree_node> left;
+  shared_ptr<tree_node> right;
+};
+
+shared_ptr<tree_node> build_tree(int depth) {
+  if (depth == 0) {
+    return shared_ptr<tree_node>();
+  }
+  return make_shared<tree_node>(
+      tree_node{depth, build_tree(depth - 1), build_tree(depth - 1)});
+}
+
+// Each iteration is one request that drops the last reference to a small
+// object, and every 64th request drops a tree of 2^range - 1 nodes. The
+// counters give the latency percentiles of the release in microseconds.
+template <bool Deferred>
+void BM_release_latency(benchmark::State& state) {
+  background_reclaimer reclaimer;
+  std::vector<double> latencies;
+  unsigned request = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    shared_ptr<tree_node> root =
+        ++request % 64 == 0 ? build_tree(state.range(0))
+                            : make_shared<tree_node>(tree_node{0, {}, {}});
+    if (Deferred) {
+      shared_ptr<tree_node> owned = std::move(root);
+      root = make_shared_deferred<tree_node>(reclaimer.queue(),
+                                             std::move(*owned));
+    }
+    state.ResumeTiming();
+    auto start = std::chrono::steady_clock::now();
+    root.reset();
+    latencies.push_back(std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+  };
+  state.counters["p50_us"] = percentile(0.5);
+  state.counters["p99_us"] = percentile(0.99);
+  state.counters["p999_us"] = percentile(0.999);
+  state.counters["max_us"] = latencies.back();
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_release_latency, false)->Arg(14)->Iterations(4096);
+BENCHMARK_TEMPLATE(BM_release_latency, true)->Arg(14)->Iterations(4096);
@@ -0,0 +1,36 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+shared_ptr<int> shared_source(new int(42));
+
+// All threads copy the same handle, so they fight for one control block.
+void BM_copy_contended(benchmark::State& state) {
+  for (auto _ : state) {
+    shared_ptr<int> copy = shared_source;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+
+// Every thread copies its own handle. This is the only way the
+// single-threaded policy may be used, and it shows the raw cost of the
+// counter update without cache line transfers.
+template <typename Policy>
+void BM_copy_private(benchmark::State& state) {
+  shared_ptr<int, Policy> source(new int(42));
+  for (auto _ : state) {
+    shared_ptr<int, Policy> copy = source;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_copy_contended)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_copy_private, atomic_policy)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_copy_private, single_threaded_policy)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
@@ -0,0 +1,44 @@
+#include "sharded-shared-ptr.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+struct registry {
+  long entries = 0;
+};
+
+shared_ptr<registry>& single_source() {
+  static auto source = make_shared<registry>();
+  return source;
+}
+
+sharded_shared_ptr<registry>& sharded_source() {
+  static auto source = make_shared_sharded<registry>();
+  return source;
+}
+
+// Every thread copies one global handle per request: all threads count on
+// the same cache line.
+void BM_hot_copy_single(benchmark::State& state) {
+  const auto& source = single_source();
+  for (auto _ : state) {
+    auto handle = source;
+    benchmark::DoNotOptimize(handle->entries);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// The same with the handle taken from the calling thread's shard.
+void BM_hot_copy_sharded(benchmark::State& state) {
+  const auto& source = sharded_source();
+  for (auto _ : state) {
+    auto handle = source.local();
+    benchmark::DoNotOptimize(handle->entries);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_hot_copy_single)->ThreadRange(1, 128)->UseRealTime();
+BENCHMARK(BM_hot_copy_sharded)->ThreadRange(1, 128)->UseRealTime();
@@ -0,0 +1,165 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <utility>
+
+// The same operations on this shared_ptr and on std::shared_ptr. Every
+// benchmark is registered once per family, so that regressions show up
+// as a ratio against the standard library on the same machine.
+//
+// libstdc++ uses plain increments while the process has only one thread,
+// so compare single-threaded results with BM_copy_contended/threads:1,
+// which runs after the benchmark library has started worker threads.
+namespace {
+
+struct ours {
+  template <typename T>
+  using ptr = ::shared_ptr<T>;
+  template <typename T>
+  using weak = ::weak_ptr<T>;
+
+  template <typename T, typename... Args>
+  static ptr<T> make(Args&&... args) {
+    return ::make_shared<T>(std::forward<Args>(args)...);
+  }
+};
+
+struct standard {
+  template <typename T>
+  using ptr = std::shared_ptr<T>;
+  template <typename T>
+  using weak = std::weak_ptr<T>;
+
+  template <typename T, typename... Args>
+  static ptr<T> make(Args&&... args) {
+    return std::make_shared<T>(std::forward<Args>(args)...);
+  }
+};
+
+template <typename Family>
+void BM_copy(benchmark::State& state) {
+  auto source = Family::template make<int>(42);
+  for (auto _ : state) {
+    typename Family::template ptr<int> copy = source;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+
+template <typename Family>
+void BM_move(benchmark::State& state) {
+  auto a = Family::template make<int>(42);
+  typename Family::template ptr<int> b;
+  for (auto _ : state) {
+    b = std::move(a);
+    a = std::move(b);
+    benchmark::DoNotOptimize(a);
+  }
+}
+
+template <typename Family>
+void BM_make_shared(benchmark::State& state) {
+  for (auto _ : state) {
+    auto p = Family::template make<int>(42);
+    benchmark::DoNotOptimize(p);
+  }
+}
+
+template <typename Family>
+void BM_from_new(benchmark::State& state) {
+  for (auto _ : state) {
+    typename Family::template ptr<int> p(new int(42));
+    benchmark::DoNotOptimize(p);
+  }
+}
+
+template <typename Family>
+void BM_weak_lock(benchmark::State& state) {
+  auto source = Family::template make<int>(42);
+  typename Family::template weak<int> weak = source;
+  for (auto _ : state) {
+    auto locked = weak.lock();
+    benchmark::DoNotOptimize(locked);
+  }
+}
+
+template <typename Family>
+void BM_weak_lock_expired(benchmark::State& state) {
+  typename Family::template weak<int> weak = Family::template make<int>(42);
+  for (auto _ : state) {
+    auto locked = weak.lock();
+    benchmark::DoNotOptimize(locked);
+  }
+}
+
+template <typename Family>
+void BM_reset(benchmark::State& state) {
+  auto source = Family::template make<int>(42);
+  for (auto _ : state) {
+    typename Family::template ptr<int> copy = source;
+    copy.reset();
+    benchmark::DoNotOptimize(copy);
+  }
+}
+
+template <typename Family>
+struct chain_node {
+  typename Family::template ptr<chain_node> next;
+};
+
+// Releases a singly linked chain of range(0) nodes. The destructor of each
+// node releases the next one, so this also measures recursion depth cost.
+template <typename Family>
+void BM_chain_destruction(benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    typename Family::template ptr<chain_node<Family>> head;
+    for (int64_t i = 0; i != state.range(0); ++i) {
+      auto node = Family::template make<chain_node<Family>>();
+      node->next = std::move(head);
+      head = std::move(node);
+    }
+    state.ResumeTiming();
+    head.reset();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Family>
+typename Family::template ptr<int>& contended_source() {
+  static auto source = Family::template make<int>(42);
+  return source;
+}
+
+// All threads copy the same handle.
+template <typename Family>
+void BM_copy_contended(benchmark::State& state) {
+  const auto& source = contended_source<Family>();
+  for (auto _ : state) {
+    auto copy = source;
+    benchmark::DoNotOptimize(copy);
+  }
+}
+
+} // namespace
+
+#define COMPARE(name)                        \
+  BENCHMARK_TEMPLATE(name, ours);            \
+  BENCHMARK_TEMPLATE(name, standard)
+
+COMPARE(BM_copy);
+COMPARE(BM_move);
+COMPARE(BM_make_shared);
+COMPARE(BM_from_new);
+COMPARE(BM_weak_lock);
+COMPARE(BM_weak_lock_expired);
+COMPARE(BM_reset);
+BENCHMARK_TEMPLATE(BM_chain_destruction, ours)->Arg(1 << 10)->Arg(1 << 14);
+BENCHMARK_TEMPLATE(BM_chain_destruction, standard)
+    ->Arg(1 << 10)
+    ->Arg(1 << 14);
+BENCHMARK_TEMPLATE(BM_copy_contended, ours)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_copy_contended, standard)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
@@ -0,0 +1,55 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+namespace {
+
+struct tree_node {
+  int value;
+  shared_ptr<tree_node> left;
+  shared_ptr<tree_node> right;
+};
+
+shared_ptr<tree_node> build_tree(int depth) {
+  if (depth == 0) {
+    return shared_ptr<tree_node>();
+  }
+  return make_shared<tree_node>(
+      tree_node{depth, build_tree(depth - 1), build_tree(depth - 1)});
+}
+
+struct point {
+  float x, y, z;
+};
+
+// Releases a balanced tree of 2^depth - 1 nodes.
+void BM_teardown_tree(benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    shared_ptr<tree_node> root = build_tree(state.range(0));
+    state.ResumeTiming();
+    root.reset();
+  }
+  state.SetItemsProcessed(state.iterations() * ((1 << state.range(0)) - 1));
+}
+
+// Releases many trivially destructible objects.
+void BM_teardown_trivial(benchmark::State& state) {
+  std::vector<shared_ptr<point>> points(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (auto& p : points) {
+      p = make_shared<point>();
+    }
+    state.ResumeTiming();
+    for (auto& p : points) {
+      p.reset();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK(BM_teardown_tree)->DenseRange(10, 18, 4);
+BENCHMARK(BM_teardown_trivial)->Range(1 << 10, 1 << 18);
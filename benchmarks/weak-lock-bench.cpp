@@ -0,0 +1,29 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+shared_ptr<int> cached_value(new int(42));
+weak_ptr<int> cache_handle = cached_value;
+weak_ptr<int> expired_handle = shared_ptr<int>(new int(43));
+
+// Cache lookup through a live weak handle shared by all readers.
+void BM_lock_hit(benchmark::State& state) {
+  for (auto _ : state) {
+    shared_ptr<int> value = cache_handle.lock();
+    benchmark::DoNotOptimize(value);
+  }
+}
+
+// Lookup of an evicted entry: lock() must fail without writing the counter.
+void BM_lock_miss(benchmark::State& state) {
+  for (auto _ : state) {
+    shared_ptr<int> value = expired_handle.lock();
+    benchmark::DoNotOptimize(value);
+  }
+}
+
+} // namespace
+
+BENCHMARK(BM_lock_hit)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_lock_miss)->ThreadRange(1, 64)->UseRealTime();
@@ -0,0 +1,58 @@
+#include "shared-ptr.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+struct blob {
+  char data[1 << 20];
+};
+
+size_t heap_in_use() {
+#ifdef __GLIBC__
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+// A cache that keeps weak handles to every entry it ever produced while
+// only the most recent entries stay strongly referenced. Reports how much
+// heap the expired entries still pin.
+template <shared_ptr<blob> (*Make)()>
+void BM_weak_cache(benchmark::State& state) {
+  constexpr size_t live = 4;
+  for (auto _ : state) {
+    size_t before = heap_in_use();
+    std::vector<weak_ptr<blob>> cache;
+    std::vector<shared_ptr<blob>> recent;
+    for (int64_t i = 0; i != state.range(0); ++i) {
+      auto entry = Make();
+      cache.emplace_back(entry);
+      recent.push_back(std::move(entry));
+      if (recent.size() > live) {
+        recent.erase(recent.begin());
+      }
+    }
+    recent.clear();
+    state.counters["pinned_MiB"] =
+        static_cast<double>(heap_in_use() - before) / (1 << 20);
+  }
+}
+
+shared_ptr<blob> make_in_place() {
+  return make_shared<blob>();
+}
+
+shared_ptr<blob> make_split() {
+  return make_shared_split<blob>();
+}
+
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_weak_cache, make_in_place)->Arg(64)->Iterations(3);
+BENCHMARK_TEMPLATE(BM_weak_cache, make_split)->Arg(64)->Iterations(3);
@@ -0,0 +1,144 @@
+#include "biased-policy.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+struct tracked {
+  explicit tracked(std::atomic<int>* destroyed) : destroyed(destroyed) {}
+
+  ~tracked() {
+    destroyed->fetch_add(1);
+  }
+
+  std::atomic<int>* destroyed;
+};
+
+using biased_ptr = shared_ptr<tracked, biased_policy>;
+using biased_weak_ptr = weak_ptr<tracked, biased_policy>;
+} // namespace
+
+TEST(biased_policy_testing, owner_only) {
+  std::atomic<int> destroyed{0};
+  {
+    biased_ptr p(new tracked(&destroyed));
+    biased_ptr q = p;
+    EXPECT_EQ(2, p.use_count());
+    q.reset();
+    EXPECT_EQ(1, p.use_count());
+  }
+  EXPECT_EQ(1, destroyed);
+}
+
+TEST(biased_policy_testing, other_thread_drops_last) {
+  std::atomic<int> destroyed{0};
+  biased_ptr p = make_shared<tracked, biased_policy>(&destroyed);
+  biased_ptr q;
+  std::thread([&] { q = p; }).join();
+  EXPECT_EQ(2, p.use_count());
+
+  // The owner share drops to zero and is merged, so the other thread sees
+  // the true count and releases the object itself.
+  p.reset();
+  EXPECT_EQ(0, destroyed);
+  std::thread([&] { q.reset(); }).join();
+  EXPECT_EQ(1, destroyed);
+}
+
+TEST(biased_policy_testing, handed_off_references_are_merged_by_owner) {
+  std::atomic<int> destroyed{0};
+  biased_ptr p(new tracked(&destroyed));
+  biased_weak_ptr w = p;
+  std::thread([p = std::move(p)]() mutable { p.reset(); }).join();
+
+  // Only the owner can see the zero, so the object waits for it. It must
+  // not come back to life in the meantime.
+  EXPECT_EQ(0, destroyed);
+  EXPECT_TRUE(w.expired());
+  EXPECT_FALSE(w.lock());
+  std::thread([&w] {
+    EXPECT_TRUE(w.expired());
+    EXPECT_FALSE(w.lock());
+  }).join();
+  EXPECT_EQ(0, destroyed);
+  biased_policy::merge_queued();
+  EXPECT_EQ(1, destroyed);
+  EXPECT_TRUE(w.expired());
+  EXPECT_FALSE(w.lock());
+}
+
+TEST(biased_policy_testing, owner_locks_before_merge) {
+  std::atomic<int> destroyed{0};
+  biased_ptr p(new tracked(&destroyed));
+  biased_ptr handed_off = p;
+  biased_weak_ptr w = p;
+  std::thread([handed_off = std::move(handed_off)]() mutable {
+    handed_off.reset();
+  }).join();
+
+  // The owner still holds p, which its own count shows.
+  EXPECT_FALSE(w.expired());
+  biased_ptr locked = w.lock();
+  EXPECT_EQ(p.get(), locked.get());
+  p.reset();
+  locked.reset();
+  biased_policy::merge_queued();
+  EXPECT_EQ(1, destroyed);
+  EXPECT_FALSE(w.lock());
+}
+
+TEST(biased_policy_testing, owner_exit_merges) {
+  std::atomic<int> destroyed{0};
+  biased_ptr kept;
+  std::thread([&] {
+    biased_ptr handed_off(new tracked(&destroyed));
+    biased_ptr p = make_shared<tracked, biased_policy>(&destroyed);
+    kept = p;
+    std::thread([handed_off = std::move(handed_off)]() mutable {
+      handed_off.reset();
+    }).join();
+  }).join();
+  // The owner merged its queue on exit.
+  EXPECT_EQ(1, destroyed);
+
+  // With the owner gone, the last releasing thread merges by itself.
+  kept.reset();
+  EXPECT_EQ(2, destroyed);
+}
+
+TEST(biased_policy_testing, weak_lock_from_other_thread) {
+  std::atomic<int> destroyed{0};
+  biased_ptr p(new tracked(&destroyed));
+  biased_weak_ptr w = p;
+  std::thread([&w] {
+    biased_ptr locked = w.lock();
+    EXPECT_TRUE(locked);
+  }).join();
+  p.reset();
+  EXPECT_EQ(1, destroyed);
+  std::thread([&w] { EXPECT_FALSE(w.lock()); }).join();
+}
+
+TEST(biased_policy_testing, concurrent_copies) {
+  std::atomic<int> destroyed{0};
+  biased_ptr p(new tracked(&destroyed));
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([p] {
+      for (int j = 0; j < 10000; ++j) {
+        biased_ptr copy = p;
+      }
+    });
+  }
+  for (int j = 0; j < 10000; ++j) {
+    biased_ptr copy = p;
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(1, p.use_count());
+  p.reset();
+  biased_policy::merge_queued();
+  EXPECT_EQ(1, destroyed);
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "shared-ptr.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Biased reference counting (Choi, Shull, Torrellas, 2018).
+//
+// The thread that creates a control block owns its counters and updates
+// its own share of each count without atomic read-modify-writes. Other
+// threads update a shared atomic word instead. The true count is the sum
+// of both, so a zero is only visible once the owner merges its share into
+// the shared word. The owner does that when its own share drops to zero.
+//
+// If other threads release references the owner handed out, the shared
+// part goes negative and nobody could see the zero. Such counters are
+// queued to the owner, which merges them in merge_queued(): on every new
+// control block it creates, on thread exit, or whenever the application
+// calls it at a quiescent point. Until then the object stays alive. Once
+// the owner thread has exited, the releasing thread merges by itself.
+struct biased_policy {
+  static constexpr bool deferred_release = true;
+
+  class counter;
+
+private:
+  struct thread_state {
+    // Counters queued for merging, or closed once the thread has exited.
+    std::atomic<counter*> queue{nullptr};
+    thread_state* next = nullptr;
+  };
+
+public:
+  class counter {
+  public:
+    explicit counter(size_t value) : owner(current_state()), biased(value) {
+      merge_queued();
+    }
+
+    counter(const counter&) = delete;
+    counter& operator=(const counter&) = delete;
+
+  private:
+    friend struct biased_policy;
+
+    // Null once the owner share has been merged into word.
+    std::atomic<thread_state*> owner;
+    // Written by the owner only, with plain loads and stores.
+    std::atomic<size_t> biased;
+    // Shared count shifted by flag_bits, plus merged and queued flags.
+    std::atomic<std::int64_t> word{0};
+    counter* next_queued = nullptr;
+    void (*on_zero)(void*) = nullptr;
+    void* context = nullptr;
+  };
+
+  static void bind(counter& cnt, void (*on_zero)(void*), void* context) {
+    cnt.on_zero = on_zero;
+    cnt.context = context;
+  }
+
+  static void increment(counter& cnt) noexcept {
+    if (cnt.owner.load(std::memory_order_relaxed) == current_state()) {
+      cnt.biased.store(cnt.biased.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+      return;
+    }
+    cnt.word.fetch_add(one, std::memory_order_relaxed);
+  }
+
+  static bool decrement(counter& cnt) noexcept {
+    thread_state* owner = cnt.owner.load(std::memory_order_relaxed);
+    if (owner == current_state()) {
+      size_t biased = cnt.biased.load(std::memory_order_relaxed) - 1;
+      cnt.biased.store(biased, std::memory_order_relaxed);
+      if (biased != 0) {
+        return false;
+      }
+      std::int64_t old = cnt.word.fetch_or(merged, std::memory_order_acq_rel);
+      cnt.owner.store(nullptr, std::memory_order_relaxed);
+      // A queued counter is finished by merge_queued() instead.
+      return shared_part(old) == 0 && !(old & queued);
+    }
+
+    std::int64_t old = cnt.word.load(std::memory_order_relaxed);
+    std::int64_t desired;
+    do {
+      desired = old - one;
+      if (!(old & merged) && !(old & queued) && shared_part(desired) < 0) {
+        desired |= queued;
+      }
+    } while (!cnt.word.compare_exchange_weak(old, desired,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_relaxed));
+    if (old & merged) {
+      return shared_part(desired) == 0 && !(desired & queued);
+    }
+    if ((desired & queued) && !(old & queued)) {
+      return enqueue(cnt, owner);
+    }
+    return false;
+  }
+
+  // A queued counter may already be zero, which only its owner can tell
+  // before the merge. Other threads then fail to lock it, even if the
+  // owner still holds references.
+  static bool increment_if_not_zero(counter& cnt) noexcept {
+    if (cnt.owner.load(std::memory_order_relaxed) == current_state()) {
+      std::int64_t total =
+          static_cast<std::int64_t>(
+              cnt.biased.load(std::memory_order_relaxed)) +
+          shared_part(cnt.word.load(std::memory_order_acquire));
+      if (total <= 0) {
+        return false;
+      }
+      increment(cnt);
+      return true;
+    }
+    std::int64_t old = cnt.word.load(std::memory_order_relaxed);
+    do {
+      if ((old & (merged | queued)) && shared_part(old) <= 0) {
+        return false;
+      }
+    } while (!cnt.word.compare_exchange_weak(old, old + one,
+                                             std::memory_order_relaxed));
+    return true;
+  }
+
+  // Exact for the owner, a snapshot for everybody else.
+  static size_t load(const counter& cnt) noexcept {
+    std::int64_t total =
+        shared_part(cnt.word.load(std::memory_order_relaxed)) +
+        static_cast<std::int64_t>(cnt.biased.load(std::memory_order_relaxed));
+    return total < 0 ? 0 : static_cast<size_t>(total);
+  }
+
+  // Merges the counters other threads queued to the calling thread and
+  // finishes those that dropped to zero.
+  static void merge_queued() noexcept {
+    thread_state* state = current_state();
+    counter* head = state->queue.load(std::memory_order_relaxed);
+    if (!head || head == closed()) {
+      return;
+    }
+    merge_list(state->queue.exchange(nullptr, std::memory_order_acquire));
+  }
+
+private:
+  static constexpr int flag_bits = 2;
+  static constexpr std::int64_t merged = 1;
+  static constexpr std::int64_t queued = 2;
+  static constexpr std::int64_t one = std::int64_t(1) << flag_bits;
+
+  static counter* closed() noexcept {
+    return reinterpret_cast<counter*>(alignof(counter));
+  }
+
+  static std::int64_t shared_part(std::int64_t word) noexcept {
+    return word >> flag_bits;
+  }
+
+  // Folds the owner share into the shared word and clears the queued
+  // flag. Returns true if the count is zero.
+  static bool merge(counter& cnt) noexcept {
+    std::int64_t add = -queued;
+    if (cnt.owner.load(std::memory_order_relaxed)) {
+      add += static_cast<std::int64_t>(
+                 cnt.biased.load(std::memory_order_relaxed)) *
+                 one +
+             merged;
+      cnt.biased.store(0, std::memory_order_relaxed);
+      cnt.owner.store(nullptr, std::memory_order_relaxed);
+    }
+    std::int64_t old = cnt.word.fetch_add(add, std::memory_order_acq_rel);
+    return shared_part(old + add) == 0;
+  }
+
+  static void merge_list(counter* head) noexcept {
+    while (head) {
+      counter* next = head->next_queued;
+      if (merge(*head)) {
+        head->on_zero(head->context);
+      }
+      head = next;
+    }
+  }
+
+  // Returns true if the caller has to finish the counter because its
+  // owner is gone.
+  static bool enqueue(counter& cnt, thread_state* owner) noexcept {
+    // Acquire pairs with the exiting owner closing its queue, after which
+    // its share can be read here.
+    counter* head = owner->queue.load(std::memory_order_acquire);
+    do {
+      if (head == closed()) {
+        return merge(cnt);
+      }
+      cnt.next_queued = head;
+    } while (!owner->queue.compare_exchange_weak(head, &cnt,
+                                                 std::memory_order_release,
+                                                 std::memory_order_acquire));
+    return false;
+  }
+
+  struct state_holder {
+    ~state_holder() {
+      merge_list(current->queue.exchange(closed(), std::memory_order_acq_rel));
+      current = nullptr;
+    }
+  };
+
+  static thread_state* current_state() noexcept {
+    if (!current) {
+      current = make_state();
+    }
+    return current;
+  }
+
+  // States are never freed: counters keep comparing against them after
+  // their thread is gone.
+  static thread_state* make_state() noexcept {
+    auto* state = new thread_state;
+    {
+      std::lock_guard<std::mutex> lock(states_mutex);
+      state->next = states;
+      states = state;
+    }
+    static thread_local state_holder holder;
+    (void)holder;
+    return state;
+  }
+
+  static inline thread_local thread_state* current = nullptr;
+  static inline std::mutex states_mutex;
+  static inline thread_state* states = nullptr;
+};
@@ -0,0 +1,147 @@
+#include "shared-ptr.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+// The registry changes the control block layout, so it is only tested
+// when the whole build defines SHARED_PTR_TRACK_BLOCKS.
+#ifdef SHARED_PTR_TRACK_BLOCKS
+namespace {
+struct graph_node {
+  shared_ptr<graph_node> left;
+  shared_ptr<graph_node> right;
+  weak_ptr<graph_node> parent;
+};
+
+void for_each_child(const graph_node& node, child_visitor& visit) {
+  visit(node.left);
+  visit(node.right);
+}
+
+// Holds shared_ptrs the scan cannot see.
+struct opaque_node {
+  shared_ptr<opaque_node> next;
+};
+
+template <typename T>
+std::vector<live_object> only(std::vector<live_object> objects) {
+  objects.erase(std::remove_if(objects.begin(), objects.end(),
+                               [](const live_object& o) {
+                                 return o.type != typeid(T).name();
+                               }),
+                objects.end());
+  return objects;
+}
+
+bool contains(const std::vector<live_object>& objects, const void* object) {
+  return std::any_of(objects.begin(), objects.end(),
+                     [&](const live_object& o) { return o.object == object; });
+}
+} // namespace
+
+TEST(block_registry_testing, lists_live_objects) {
+  auto a = make_shared<graph_node>();
+  shared_ptr<graph_node> b(new graph_node);
+  auto c = b;
+  auto live = only<graph_node>(block_registry::live_objects());
+  ASSERT_EQ(2, live.size());
+  EXPECT_TRUE(contains(live, a.get()));
+  EXPECT_TRUE(contains(live, b.get()));
+  for (const auto& object : live) {
+    EXPECT_GE(object.age.count(), 0);
+    EXPECT_EQ(object.object == b.get() ? 2 : 1, object.use_count);
+  }
+  b.reset();
+  c.reset();
+  live = only<graph_node>(block_registry::live_objects());
+  ASSERT_EQ(1, live.size());
+  EXPECT_EQ(a.get(), live[0].object);
+}
+
+TEST(block_registry_testing, lists_arrays_and_aliases) {
+  auto array = make_shared<int[]>(4);
+  shared_ptr<int> alias(array, &array[2]);
+  auto live = only<int[]>(block_registry::live_objects());
+  ASSERT_EQ(1, live.size());
+  EXPECT_EQ(array.get(), live[0].object);
+  EXPECT_EQ(2, live[0].use_count);
+}
+
+TEST(block_registry_testing, objects_from_other_threads) {
+  std::vector<shared_ptr<graph_node>> nodes(4);
+  std::vector<std::thread> threads;
+  for (auto& node : nodes) {
+    threads.emplace_back([&node] { node = make_shared<graph_node>(); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(4, only<graph_node>(block_registry::live_objects()).size());
+  nodes.clear();
+  EXPECT_EQ(0, only<graph_node>(block_registry::live_objects()).size());
+}
+
+TEST(block_registry_testing, finds_unreachable_cycle) {
+  auto a = make_shared<graph_node>();
+  auto b = make_shared<graph_node>();
+  a->left = b;
+  b->left = a;
+  graph_node* raw_a = a.get();
+  graph_node* raw_b = b.get();
+
+  EXPECT_EQ(0, only<graph_node>(block_registry::find_cycles()).size());
+  a.reset();
+  EXPECT_EQ(0, only<graph_node>(block_registry::find_cycles()).size());
+  b.reset();
+
+  auto garbage = only<graph_node>(block_registry::find_cycles());
+  ASSERT_EQ(2, garbage.size());
+  EXPECT_TRUE(contains(garbage, raw_a));
+  EXPECT_TRUE(contains(garbage, raw_b));
+
+  // Break the cycle, which frees both.
+  auto keep = raw_a->left;
+  raw_a->left.reset();
+  keep->left.reset();
+  keep.reset();
+  EXPECT_EQ(0, only<graph_node>(block_registry::live_objects()).size());
+}
+
+TEST(block_registry_testing, reports_what_hangs_off_a_cycle) {
+  auto root = make_shared<graph_node>();
+  root->left = root;
+  root->right = make_shared<graph_node>();
+  root->right->parent = root;
+  graph_node* raw_root = root.get();
+  graph_node* raw_leaf = root->right.get();
+
+  auto external = root->right;
+  root.reset();
+  auto garbage = only<graph_node>(block_registry::find_cycles());
+  ASSERT_EQ(1, garbage.size());
+  EXPECT_EQ(raw_root, garbage[0].object);
+
+  external.reset();
+  garbage = only<graph_node>(block_registry::find_cycles());
+  ASSERT_EQ(2, garbage.size());
+  EXPECT_TRUE(contains(garbage, raw_leaf));
+
+  raw_root->left.reset();
+  EXPECT_EQ(0, only<graph_node>(block_registry::live_objects()).size());
+}
+
+TEST(block_registry_testing, opaque_cycles_are_not_reported) {
+  auto a = make_shared<opaque_node>();
+  a->next = make_shared<opaque_node>();
+  a->next->next = a;
+  opaque_node* raw_a = a.get();
+  a.reset();
+  EXPECT_EQ(2, only<opaque_node>(block_registry::live_objects()).size());
+  EXPECT_EQ(0, only<opaque_node>(block_registry::find_cycles()).size());
+  auto keep = raw_a->next;
+  raw_a->next.reset();
+  keep->next.reset();
+}
+#endif
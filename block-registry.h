@@ -0,0 +1,233 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <typeinfo>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct shared_ptr_access;
+
+// Passed to for_each_child(const T&, child_visitor&), which types may
+// provide next to themselves to let the cycle scan see the shared_ptrs
+// they own. Call it with every owned shared_ptr; weak_ptrs do not count.
+class child_visitor {
+public:
+  template <typename Handle, typename Access = shared_ptr_access>
+  void operator()(const Handle& child) {
+    if (const void* block = Access::block(child)) {
+      children.push_back(block);
+    }
+  }
+
+private:
+  friend class block_registry;
+
+  std::vector<const void*> children;
+};
+
+// Registry entry embedded in each control block when
+// SHARED_PTR_TRACK_BLOCKS is defined. It exists from the creation of the
+// object until its destruction.
+struct tracked_object {
+  tracked_object* prev = nullptr;
+  tracked_object* next = nullptr;
+  unsigned stripe = 0;
+  const void* block = nullptr;
+  const void* object = nullptr;
+  const char* type = nullptr;
+  std::chrono::steady_clock::time_point created;
+  size_t (*use_count)(const void* block) noexcept = nullptr;
+  void (*visit_children)(const void* object, child_visitor& visitor) = nullptr;
+};
+
+// One live object as reported by block_registry.
+struct live_object {
+  const char* type;
+  const void* object;
+  std::chrono::steady_clock::duration age;
+  size_t use_count;
+};
+
+// All objects currently owned by shared_ptrs, in a few mutex-protected
+// lists so that threads seldom wait for each other.
+//
+// find_cycles() is a synchronous trial deletion in the manner of Bacon
+// and Rajan: it subtracts the references objects hold to each other from
+// their counts, keeps what is still referenced from outside and whatever
+// that reaches, and returns the rest, which only cycles keep alive. Objects
+// without for_each_child() count as referenced from outside, so the scan
+// never reports a live object. It reads the child handles without any
+// synchronization, so the graph must not change while it runs.
+class block_registry {
+public:
+  template <typename V>
+  static void add(tracked_object& entry, const void* block, const void* object,
+                  size_t (*use_count)(const void*) noexcept) noexcept {
+    entry.block = block;
+    entry.object = object;
+    entry.type = typeid(V).name();
+    entry.created = std::chrono::steady_clock::now();
+    entry.use_count = use_count;
+    entry.visit_children = nullptr;
+    if constexpr (!std::is_array_v<V> && has_children<V>::value) {
+      if (object) {
+        entry.visit_children = [](const void* p, child_visitor& visitor) {
+          for_each_child(*static_cast<const V*>(p), visitor);
+        };
+      }
+    }
+    entry.stripe = local_stripe();
+    stripe_list& list = stripes[entry.stripe];
+    std::lock_guard<std::mutex> lock(list.mutex);
+    entry.next = list.head;
+    if (list.head) {
+      list.head->prev = &entry;
+    }
+    list.head = &entry;
+  }
+
+  static void remove(tracked_object& entry) noexcept {
+    if (!entry.type) {
+      return;
+    }
+    stripe_list& list = stripes[entry.stripe];
+    std::lock_guard<std::mutex> lock(list.mutex);
+    if (entry.prev) {
+      entry.prev->next = entry.next;
+    } else {
+      list.head = entry.next;
+    }
+    if (entry.next) {
+      entry.next->prev = entry.prev;
+    }
+    entry.prev = entry.next = nullptr;
+    entry.type = nullptr;
+  }
+
+  static std::vector<live_object> live_objects() {
+    all_stripes lock;
+    auto now = std::chrono::steady_clock::now();
+    std::vector<live_object> result;
+    for (auto& list : stripes) {
+      for (tracked_object* e = list.head; e; e = e->next) {
+        result.push_back(describe(*e, now));
+      }
+    }
+    return result;
+  }
+
+  static std::vector<live_object> find_cycles() {
+    all_stripes lock;
+    std::vector<tracked_object*> entries;
+    std::unordered_map<const void*, size_t> index;
+    for (auto& list : stripes) {
+      for (tracked_object* e = list.head; e; e = e->next) {
+        index.emplace(e->block, entries.size());
+        entries.push_back(e);
+      }
+    }
+
+    std::vector<std::vector<size_t>> edges(entries.size());
+    std::vector<std::ptrdiff_t> outside(entries.size());
+    for (size_t i = 0; i != entries.size(); ++i) {
+      outside[i] = static_cast<std::ptrdiff_t>(
+          entries[i]->use_count(entries[i]->block));
+    }
+    for (size_t i = 0; i != entries.size(); ++i) {
+      if (!entries[i]->visit_children) {
+        continue;
+      }
+      child_visitor visitor;
+      entries[i]->visit_children(entries[i]->object, visitor);
+      for (const void* child : visitor.children) {
+        auto found = index.find(child);
+        if (found != index.end()) {
+          edges[i].push_back(found->second);
+          --outside[found->second];
+        }
+      }
+    }
+
+    std::vector<bool> reachable(entries.size());
+    std::vector<size_t> pending;
+    for (size_t i = 0; i != entries.size(); ++i) {
+      if (outside[i] > 0) {
+        reachable[i] = true;
+        pending.push_back(i);
+      }
+    }
+    while (!pending.empty()) {
+      size_t i = pending.back();
+      pending.pop_back();
+      for (size_t child : edges[i]) {
+        if (!reachable[child]) {
+          reachable[child] = true;
+          pending.push_back(child);
+        }
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<live_object> garbage;
+    for (size_t i = 0; i != entries.size(); ++i) {
+      if (!reachable[i]) {
+        garbage.push_back(describe(*entries[i], now));
+      }
+    }
+    return garbage;
+  }
+
+private:
+  static constexpr unsigned stripe_count = 16;
+
+  struct stripe_list {
+    std::mutex mutex;
+    tracked_object* head = nullptr;
+  };
+
+  struct all_stripes {
+    all_stripes() {
+      for (auto& list : stripes) {
+        list.mutex.lock();
+      }
+    }
+
+    ~all_stripes() {
+      for (auto& list : stripes) {
+        list.mutex.unlock();
+      }
+    }
+  };
+
+  template <typename V, typename = void>
+  struct has_children : std::false_type {};
+
+  template <typename V>
+  struct has_children<V, std::void_t<decltype(for_each_child(
+                             std::declval<const V&>(),
+                             std::declval<child_visitor&>()))>>
+      : std::true_type {};
+
+  static live_object describe(const tracked_object& entry,
+                              std::chrono::steady_clock::time_point now) {
+    return {entry.type, entry.object, now - entry.created,
+            entry.use_count(entry.block)};
+  }
+
+  static unsigned local_stripe() noexcept {
+    static std::atomic<unsigned> next{0};
+    static thread_local unsigned stripe =
+        next.fetch_add(1, std::memory_order_relaxed) % stripe_count;
+    return stripe;
+  }
+
+  static stripe_list stripes[stripe_count];
+};
+
+inline block_registry::stripe_list
+    block_registry::stripes[block_registry::stripe_count];
@@ -0,0 +1,77 @@
+#include "borrowed-ptr.h"
+#include "tests-extra/test-object.h"
+#include <gtest/gtest.h>
+
+namespace {
+struct base {
+  int value = 1;
+};
+
+struct derived : base {
+  int extra = 2;
+};
+
+int read(borrowed_ptr<const base> b) {
+  return b->value;
+}
+
+size_t keep(borrowed_ptr<test_object> b, shared_ptr<test_object>& out) {
+  out = b.to_shared();
+  return out.use_count();
+}
+} // namespace
+
+TEST(borrowed_ptr_testing, no_count_traffic) {
+  test_object::no_new_instances_guard g;
+  auto p = make_shared<test_object>(42);
+  borrowed_ptr<test_object> b = p;
+  EXPECT_EQ(1, p.use_count());
+  EXPECT_EQ(p.get(), b.get());
+  EXPECT_EQ(42, *b);
+  borrowed_ptr<test_object> copy = b;
+  EXPECT_TRUE(copy == b);
+  EXPECT_EQ(1, p.use_count());
+}
+
+TEST(borrowed_ptr_testing, null) {
+  borrowed_ptr<int> b;
+  EXPECT_FALSE(b);
+  EXPECT_TRUE(b == nullptr);
+  EXPECT_FALSE(b.to_shared());
+  shared_ptr<int> empty;
+  EXPECT_FALSE(borrowed_ptr<int>(empty));
+}
+
+TEST(borrowed_ptr_testing, as_argument) {
+  test_object::no_new_instances_guard g;
+  auto d = make_shared<derived>();
+  EXPECT_EQ(1, read(d));
+  EXPECT_EQ(1, read(make_shared<base>()));
+
+  auto p = make_shared<test_object>(42);
+  shared_ptr<test_object> kept;
+  EXPECT_EQ(2, keep(p, kept));
+  p.reset();
+  EXPECT_EQ(42, *kept);
+}
+
+TEST(borrowed_ptr_testing, arrays) {
+  auto a = make_shared<int[]>(3, 7);
+  borrowed_ptr<int[]> b = a;
+  EXPECT_EQ(7, b[2]);
+}
+
+#ifdef SHARED_PTR_CHECK_BORROWS
+TEST(borrowed_ptr_testing, use_after_release) {
+  EXPECT_DEATH(
+      {
+        auto p = make_shared<int>(1);
+        borrowed_ptr<int> b = p;
+        p.reset();
+        (void)*b;
+      },
+      "borrowed_ptr used after its object was released");
+}
+#else
+static_assert(std::is_trivially_copyable_v<borrowed_ptr<int>>);
+#endif
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "shared-ptr.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+
+// Non-owning view of an object held by a shared_ptr, meant for function
+// parameters. Creating and copying one touches no counts; to_shared()
+// adds a reference only where the callee really keeps the object.
+//
+// Like std::string_view, it must not outlive the handles it was taken
+// from. With SHARED_PTR_CHECK_BORROWS each borrow holds a weak reference,
+// so that dereferencing after the last shared_ptr went away aborts instead
+// of reading freed memory. The macro changes the layout of borrowed_ptr,
+// so it must be defined for the whole program or not at all.
+template <typename T, typename Policy = atomic_policy>
+class borrowed_ptr {
+public:
+  using element_type = std::remove_extent_t<T>;
+
+  template <typename V, typename P>
+  friend class borrowed_ptr;
+
+  constexpr borrowed_ptr() noexcept = default;
+
+  constexpr borrowed_ptr(std::nullptr_t) noexcept {}
+
+  template <typename V, typename = std::enable_if_t<std::is_convertible_v<
+                            typename shared_ptr<V, Policy>::element_type*,
+                            element_type*>>>
+  borrowed_ptr(const shared_ptr<V, Policy>& shared) noexcept
+      : object_ptr(shared.get()),
+        control_block_ptr(shared_ptr_access::block(shared)) {
+    add_check();
+  }
+
+  template <typename V, typename = std::enable_if_t<std::is_convertible_v<
+                            typename borrowed_ptr<V, Policy>::element_type*,
+                            element_type*>>>
+  borrowed_ptr(const borrowed_ptr<V, Policy>& other) noexcept
+      : object_ptr(other.object_ptr),
+        control_block_ptr(other.control_block_ptr) {
+    add_check();
+  }
+
+#ifdef SHARED_PTR_CHECK_BORROWS
+  borrowed_ptr(const borrowed_ptr& other) noexcept
+      : object_ptr(other.object_ptr),
+        control_block_ptr(other.control_block_ptr) {
+    add_check();
+  }
+
+  borrowed_ptr& operator=(const borrowed_ptr& other) noexcept {
+    borrowed_ptr copy(other);
+    std::swap(object_ptr, copy.object_ptr);
+    std::swap(control_block_ptr, copy.control_block_ptr);
+    return *this;
+  }
+
+  ~borrowed_ptr() {
+    if (control_block_ptr && control_block_ptr->remove_weak()) {
+      control_block_ptr->deleteControlBlock();
+    }
+  }
+#endif
+
+  element_type* get() const noexcept {
+    check();
+    return object_ptr;
+  }
+
+  element_type& operator*() const noexcept {
+    return *get();
+  }
+
+  element_type* operator->() const noexcept {
+    return get();
+  }
+
+  template <typename V = T, typename = std::enable_if_t<std::is_array_v<V>>>
+  element_type& operator[](std::ptrdiff_t index) const noexcept {
+    return get()[index];
+  }
+
+  explicit operator bool() const noexcept {
+    return object_ptr;
+  }
+
+  bool operator==(const borrowed_ptr& rhs) const noexcept {
+    return object_ptr == rhs.object_ptr;
+  }
+
+  bool operator!=(const borrowed_ptr& rhs) const noexcept {
+    return object_ptr != rhs.object_ptr;
+  }
+
+  // Takes a reference of its own for the caller to keep.
+  shared_ptr<T, Policy> to_shared() const noexcept {
+    check();
+    if (!control_block_ptr) {
+      return shared_ptr<T, Policy>();
+    }
+    control_block_ptr->add_shared();
+    return shared_ptr_access::adopt<T, Policy>(control_block_ptr, object_ptr);
+  }
+
+private:
+  void add_check() noexcept {
+#ifdef SHARED_PTR_CHECK_BORROWS
+    if (control_block_ptr) {
+      control_block_ptr->add_weak();
+    }
+#endif
+  }
+
+  void check() const noexcept {
+#ifdef SHARED_PTR_CHECK_BORROWS
+    if (control_block_ptr && control_block_ptr->use_count() == 0) {
+      std::fputs("borrowed_ptr used after its object was released\n", stderr);
+      std::abort();
+    }
+#endif
+  }
+
+  element_type* object_ptr = nullptr;
+  ControlBlock<Policy>* control_block_ptr = nullptr;
+};
+
+template <typename T, typename Policy>
+struct is_trivially_relocatable<borrowed_ptr<T, Policy>> : std::true_type {};
@@ -0,0 +1,107 @@
+#include "compact-shared-ptr.h"
+#include "tests-extra/test-object.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+static_assert(sizeof(compact_shared_ptr<test_object>) == sizeof(void*));
+
+namespace {
+struct self_aware : enable_shared_from_this<self_aware> {
+  int value = 5;
+};
+} // namespace
+
+TEST(compact_shared_ptr_testing, default_ctor) {
+  compact_shared_ptr<test_object> p;
+  EXPECT_EQ(nullptr, p.get());
+  EXPECT_FALSE(static_cast<bool>(p));
+  EXPECT_EQ(0, p.use_count());
+  EXPECT_FALSE(static_cast<shared_ptr<test_object>>(p));
+  EXPECT_TRUE(static_cast<weak_ptr<test_object>>(p).expired());
+}
+
+TEST(compact_shared_ptr_testing, make_compact_shared) {
+  test_object::no_new_instances_guard g;
+  auto p = make_compact_shared<test_object>(42);
+  EXPECT_EQ(42, *p);
+  EXPECT_EQ(1, p.use_count());
+  {
+    compact_shared_ptr<test_object> q = p;
+    EXPECT_EQ(2, p.use_count());
+    EXPECT_TRUE(p == q);
+    compact_shared_ptr<test_object> moved = std::move(q);
+    EXPECT_FALSE(static_cast<bool>(q));
+    EXPECT_EQ(2, p.use_count());
+  }
+  EXPECT_EQ(1, p.use_count());
+  p.reset();
+  EXPECT_FALSE(static_cast<bool>(p));
+}
+
+TEST(compact_shared_ptr_testing, to_shared_and_weak) {
+  test_object::no_new_instances_guard g;
+  auto p = make_compact_shared<test_object>(42);
+  shared_ptr<test_object> s = p;
+  EXPECT_EQ(2, s.use_count());
+  EXPECT_EQ(p.get(), s.get());
+
+  weak_ptr<test_object> w = p;
+  EXPECT_EQ(2, w.use_count());
+  s.reset();
+
+  shared_ptr<test_object> moved = std::move(p);
+  EXPECT_FALSE(static_cast<bool>(p));
+  EXPECT_EQ(1, moved.use_count());
+
+  compact_shared_ptr<test_object> back = compact_shared_from(w.lock());
+  ASSERT_TRUE(static_cast<bool>(back));
+  EXPECT_EQ(moved.get(), back.get());
+  EXPECT_EQ(2, back.use_count());
+  moved.reset();
+  back.reset();
+  EXPECT_TRUE(w.expired());
+}
+
+TEST(compact_shared_ptr_testing, compact_shared_from_rejects) {
+  test_object::no_new_instances_guard g;
+  shared_ptr<test_object> separate(new test_object(1));
+  EXPECT_FALSE(compact_shared_from(std::move(separate)));
+  EXPECT_TRUE(static_cast<bool>(separate));
+
+  auto aligned = make_shared<test_object>(cache_aligned, 3);
+  EXPECT_FALSE(compact_shared_from(std::move(aligned)));
+  EXPECT_TRUE(static_cast<bool>(aligned));
+
+  // Aliasing the whole object is as good as the original handle.
+  auto whole = make_shared<test_object>(2);
+  shared_ptr<test_object> aliased(whole, whole.get());
+  EXPECT_TRUE(static_cast<bool>(compact_shared_from(std::move(aliased))));
+
+  struct holder {
+    test_object first{4};
+    test_object second{5};
+  };
+  auto outer = make_shared<holder>();
+  shared_ptr<test_object> member(outer, &outer->second);
+  EXPECT_FALSE(compact_shared_from(std::move(member)));
+  EXPECT_TRUE(static_cast<bool>(member));
+}
+
+TEST(compact_shared_ptr_testing, shared_from_this) {
+  auto p = make_compact_shared<self_aware>();
+  shared_ptr<self_aware> s = p->shared_from_this();
+  EXPECT_EQ(p.get(), s.get());
+  EXPECT_EQ(2, p.use_count());
+}
+
+TEST(compact_shared_ptr_testing, container) {
+  test_object::no_new_instances_guard g;
+  std::vector<compact_shared_ptr<test_object>> handles;
+  auto first = make_compact_shared<test_object>(0);
+  for (int i = 0; i != 100; ++i) {
+    handles.push_back(i % 2 ? first : make_compact_shared<test_object>(i));
+  }
+  EXPECT_EQ(51, first.use_count());
+  handles.clear();
+  EXPECT_EQ(1, first.use_count());
+}
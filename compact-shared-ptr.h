@@ -0,0 +1,170 @@
+#pragma once
+
+#include "shared-ptr.h"
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// Shared handle that stores only the control block pointer. It works for
+// objects whose block type is known, which are the ones made by
+// make_compact_shared() or an equivalent allocate_shared() with
+// std::allocator: the object sits inside the block at a fixed place. So
+// there is no aliasing, no custom deleter or allocator, and no arrays.
+//
+// Converts to shared_ptr and weak_ptr of the same object without touching
+// the counters more than the conversion itself requires.
+template <typename T, typename Policy = atomic_policy>
+class compact_shared_ptr {
+  static_assert(!std::is_array_v<T>, "arrays need the element count");
+
+  using block_type = ControlBlockWithValue<T, Policy, std::allocator<T>>;
+
+public:
+  using element_type = T;
+
+  template <typename V, typename P, typename... Args>
+  friend compact_shared_ptr<V, P> make_compact_shared(Args&&... args);
+
+  template <typename V, typename P>
+  friend compact_shared_ptr<V, P> compact_shared_from(
+      shared_ptr<V, P>&& shared) noexcept;
+
+  constexpr compact_shared_ptr() noexcept = default;
+
+  constexpr explicit compact_shared_ptr(std::nullptr_t) noexcept {}
+
+  compact_shared_ptr(const compact_shared_ptr& other) noexcept
+      : block(other.block) {
+    if (block) {
+      block->add_shared();
+    }
+  }
+
+  compact_shared_ptr(compact_shared_ptr&& other) noexcept
+      : block(other.block) {
+    other.block = nullptr;
+  }
+
+  compact_shared_ptr& operator=(const compact_shared_ptr& other) noexcept {
+    compact_shared_ptr(other).swap(*this);
+    return *this;
+  }
+
+  compact_shared_ptr& operator=(compact_shared_ptr&& other) noexcept {
+    compact_shared_ptr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  operator shared_ptr<T, Policy>() const& noexcept {
+    if (!block) {
+      return shared_ptr<T, Policy>();
+    }
+    block->add_shared();
+    return shared_ptr_access::adopt<T, Policy>(block, get());
+  }
+
+  operator shared_ptr<T, Policy>() && noexcept {
+    if (!block) {
+      return shared_ptr<T, Policy>();
+    }
+    auto shared = shared_ptr_access::adopt<T, Policy>(block, get());
+    block = nullptr;
+    return shared;
+  }
+
+  operator weak_ptr<T, Policy>() const noexcept {
+    if (!block) {
+      return weak_ptr<T, Policy>();
+    }
+    // Borrows our reference for the conversion instead of adding one.
+    auto borrowed = shared_ptr_access::adopt<T, Policy>(block, get());
+    weak_ptr<T, Policy> weak = borrowed;
+    shared_ptr_access::release(borrowed);
+    return weak;
+  }
+
+  T* get() const noexcept {
+    return block ? reinterpret_cast<T*>(&block->object_storage) : nullptr;
+  }
+
+  T& operator*() const noexcept {
+    return *get();
+  }
+
+  T* operator->() const noexcept {
+    return get();
+  }
+
+  explicit operator bool() const noexcept {
+    return block;
+  }
+
+  bool operator==(const compact_shared_ptr& rhs) const noexcept {
+    return block == rhs.block;
+  }
+
+  bool operator!=(const compact_shared_ptr& rhs) const noexcept {
+    return block != rhs.block;
+  }
+
+  size_t use_count() const noexcept {
+    return block ? block->use_count() : 0;
+  }
+
+  void reset() noexcept {
+    compact_shared_ptr().swap(*this);
+  }
+
+  void swap(compact_shared_ptr& other) noexcept {
+    std::swap(block, other.block);
+  }
+
+  ~compact_shared_ptr() {
+    if (block && block->remove_shared()) {
+      ControlBlock<Policy>::release_last_shared(
+          static_cast<ControlBlock<Policy>*>(block));
+    }
+  }
+
+private:
+  explicit compact_shared_ptr(block_type* block) noexcept : block(block) {}
+
+  static bool is_compact(ControlBlock<Policy>* block, const T* ptr) noexcept {
+    return block && block->ops == &block_type::ops &&
+           ptr == reinterpret_cast<const T*>(
+                      &static_cast<block_type*>(block)->object_storage);
+  }
+
+  block_type* block = nullptr;
+};
+
+template <typename T, typename Policy = atomic_policy, typename... Args>
+compact_shared_ptr<T, Policy> make_compact_shared(Args&&... args) {
+  // Not make_shared(), which may split large objects off the block.
+  auto shared = allocate_shared<T, Policy>(std::allocator<T>(),
+                                           std::forward<Args>(args)...);
+  return compact_shared_ptr<T, Policy>(
+      static_cast<typename compact_shared_ptr<T, Policy>::block_type*>(
+          shared_ptr_access::release(shared)));
+}
+
+// Takes over shared if it owns a whole object in a compact block, for
+// example after weak_ptr::lock(). Otherwise returns an empty handle and
+// leaves shared alone.
+template <typename T, typename Policy>
+compact_shared_ptr<T, Policy> compact_shared_from(
+    shared_ptr<T, Policy>&& shared) noexcept {
+  using compact = compact_shared_ptr<T, Policy>;
+  ControlBlock<Policy>* block = shared_ptr_access::block(shared);
+  if (!compact::is_compact(block, shared.get())) {
+    return compact();
+  }
+  shared_ptr_access::release(shared);
+  return compact(static_cast<typename compact::block_type*>(block));
+}
+
+template <typename T, typename Policy>
+struct is_trivially_relocatable<compact_shared_ptr<T, Policy>>
+    : std::true_type {};
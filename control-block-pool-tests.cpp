@@ -0,0 +1,69 @@
+#include "control-block-pool.h"
+#include "shared-ptr.h"
+#include "tests-extra/test-object.h"
+#include <gtest/gtest.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST(control_block_pool_testing, reuses_blocks) {
+  control_block_pool_allocator<long> alloc;
+  long* p = alloc.allocate(1);
+  alloc.deallocate(p, 1);
+  long* q = alloc.allocate(1);
+  EXPECT_EQ(p, q);
+  alloc.deallocate(q, 1);
+}
+
+TEST(control_block_pool_testing, distinct_blocks) {
+  control_block_pool_allocator<long> alloc;
+  std::set<long*> blocks;
+  for (size_t i = 0; i != 100000; ++i) {
+    long* p = alloc.allocate(1);
+    EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(p) % alignof(long));
+    EXPECT_TRUE(blocks.insert(p).second);
+  }
+  for (long* p : blocks) {
+    alloc.deallocate(p, 1);
+  }
+}
+
+TEST(control_block_pool_testing, array_allocation) {
+  control_block_pool_allocator<long> alloc;
+  long* p = alloc.allocate(16);
+  p[15] = 42;
+  alloc.deallocate(p, 16);
+}
+
+TEST(control_block_pool_testing, shared_ptr_with_pool) {
+  test_object::no_new_instances_guard g;
+  control_block_pool_allocator<test_object> alloc;
+  shared_ptr<test_object> p(new test_object(42),
+                            std::default_delete<test_object>(), alloc);
+  auto q = allocate_shared<test_object>(alloc, 43);
+  weak_ptr<test_object> w = q;
+  EXPECT_EQ(42, *p);
+  EXPECT_EQ(43, *w.lock());
+}
+
+TEST(control_block_pool_testing, cross_thread_release) {
+  control_block_pool_allocator<int> alloc;
+  std::vector<shared_ptr<int>> handles;
+  for (int i = 0; i != 1000; ++i) {
+    handles.emplace_back(new int(i), std::default_delete<int>(), alloc);
+  }
+  std::thread t([moved = std::move(handles)]() mutable { moved.clear(); });
+  t.join();
+
+  handles.clear();
+  std::thread producer([&] {
+    for (int i = 0; i != 1000; ++i) {
+      handles.emplace_back(new int(i), std::default_delete<int>(), alloc);
+    }
+  });
+  producer.join();
+  for (int i = 0; i != 1000; ++i) {
+    EXPECT_EQ(i, *handles[i]);
+  }
+  handles.clear();
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+
+// Pool of equally sized blocks with one cache per thread.
+//
+// Blocks are carved from slabs aligned to slab_size, and each slab header
+// names the cache that owns it. A block freed by the owning thread goes
+// back to that cache's free list without any synchronization. A block
+// freed by another thread is pushed onto the owner's remote list with a
+// CAS, and the owner takes the whole list back in one exchange once it
+// runs out of local blocks. When a thread exits, its cache is parked on an
+// orphan list and adopted by the next thread that needs one, so slabs are
+// reused but never returned to the system.
+template <size_t BlockSize, size_t BlockAlign>
+class fixed_size_pool {
+  struct free_node {
+    free_node* next;
+  };
+
+  struct thread_cache;
+
+  struct slab_header {
+    thread_cache* owner;
+    slab_header* next;
+  };
+
+  static constexpr size_t round_up(size_t value, size_t to) {
+    return (value + to - 1) / to * to;
+  }
+
+  static constexpr size_t alignment =
+      BlockAlign < alignof(free_node) ? alignof(free_node) : BlockAlign;
+  static constexpr size_t stride =
+      round_up(BlockSize < sizeof(free_node) ? sizeof(free_node) : BlockSize,
+               alignment);
+  static constexpr size_t first_block = round_up(sizeof(slab_header), alignment);
+
+public:
+  static constexpr size_t slab_size = 64 * 1024;
+  static constexpr bool is_pooled = first_block + stride <= slab_size;
+
+  static void* allocate() {
+    thread_cache* cache = current_cache();
+    if (!cache->local) {
+      cache->local = cache->remote.exchange(nullptr, std::memory_order_acquire);
+    }
+    if (free_node* node = cache->local) {
+      cache->local = node->next;
+      return node;
+    }
+    if (cache->bump == cache->bump_end) {
+      add_slab(cache);
+    }
+    void* block = cache->bump;
+    cache->bump += stride;
+    return block;
+  }
+
+  static void deallocate(void* block) noexcept {
+    auto* slab = reinterpret_cast<slab_header*>(
+        reinterpret_cast<std::uintptr_t>(block) & ~(slab_size - 1));
+    thread_cache* owner = slab->owner;
+    auto* node = static_cast<free_node*>(block);
+    if (owner == current) {
+      node->next = owner->local;
+      owner->local = node;
+      return;
+    }
+    node->next = owner->remote.load(std::memory_order_relaxed);
+    while (!owner->remote.compare_exchange_weak(node->next, node,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed)) {
+    }
+  }
+
+private:
+  struct thread_cache {
+    free_node* local = nullptr;
+    std::atomic<free_node*> remote{nullptr};
+    char* bump = nullptr;
+    char* bump_end = nullptr;
+    slab_header* slabs = nullptr;
+    thread_cache* next_orphan = nullptr;
+  };
+
+  // Only registers the thread for exit, so that the hot paths read a
+  // trivially destructible thread_local without an init guard.
+  struct cache_holder {
+    ~cache_holder() {
+      std::lock_guard<std::mutex> lock(orphans_mutex);
+      current->next_orphan = orphans;
+      orphans = current;
+      current = nullptr;
+    }
+  };
+
+  static thread_cache* current_cache() {
+    if (!current) {
+      current = adopt_cache();
+      static thread_local cache_holder holder;
+      (void)holder;
+    }
+    return current;
+  }
+
+  static thread_cache* adopt_cache() {
+    {
+      std::lock_guard<std::mutex> lock(orphans_mutex);
+      if (thread_cache* cache = orphans) {
+        orphans = cache->next_orphan;
+        return cache;
+      }
+    }
+    return new thread_cache;
+  }
+
+  static void add_slab(thread_cache* cache) {
+    void* memory = ::operator new(slab_size, std::align_val_t(slab_size));
+    auto* slab = ::new (memory) slab_header{cache, cache->slabs};
+    cache->slabs = slab;
+    cache->bump = static_cast<char*>(memory) + first_block;
+    cache->bump_end =
+        cache->bump + (slab_size - first_block) / stride * stride;
+  }
+
+  static inline thread_local thread_cache* current = nullptr;
+  static inline std::mutex orphans_mutex;
+  static inline thread_cache* orphans = nullptr;
+};
+
+// Allocator that serves single objects from a fixed_size_pool for its
+// value type. Array allocations and types too big for a slab go to the
+// global operator new.
+template <typename T>
+struct control_block_pool_allocator {
+  using value_type = T;
+
+  control_block_pool_allocator() noexcept = default;
+
+  template <typename U>
+  control_block_pool_allocator(const control_block_pool_allocator<U>&) noexcept {}
+
+  T* allocate(size_t n) {
+    if (n != 1 || !pool::is_pooled) {
+      return std::allocator<T>().allocate(n);
+    }
+    return static_cast<T*>(pool::allocate());
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    if (n != 1 || !pool::is_pooled) {
+      std::allocator<T>().deallocate(p, n);
+      return;
+    }
+    pool::deallocate(p);
+  }
+
+  template <typename U>
+  bool operator==(const control_block_pool_allocator<U>&) const noexcept {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const control_block_pool_allocator<U>&) const noexcept {
+    return false;
+  }
+
+private:
+  using pool = fixed_size_pool<sizeof(T), alignof(T)>;
+};
@@ -0,0 +1,101 @@
+#include "deferred-reclaim.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+struct tracked {
+  explicit tracked(std::atomic<int>* destroyed, int value = 0)
+      : destroyed(destroyed), value(value) {}
+
+  ~tracked() {
+    destroyed->fetch_add(1);
+  }
+
+  std::atomic<int>* destroyed;
+  int value;
+};
+
+struct ordered {
+  ordered(std::vector<int>* log, int id) : log(log), id(id) {}
+
+  ~ordered() {
+    log->push_back(id);
+  }
+
+  std::vector<int>* log;
+  int id;
+};
+} // namespace
+
+TEST(deferred_reclaim_testing, destroyed_on_drain) {
+  std::atomic<int> destroyed{0};
+  reclamation_queue queue;
+  shared_ptr<tracked> p = make_shared_deferred<tracked>(queue, &destroyed, 7);
+  EXPECT_EQ(7, p->value);
+  weak_ptr<tracked> w = p;
+  p.reset();
+  EXPECT_TRUE(w.expired());
+  EXPECT_EQ(0, destroyed);
+  EXPECT_FALSE(queue.empty());
+  EXPECT_EQ(1, queue.drain());
+  EXPECT_EQ(1, destroyed);
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(deferred_reclaim_testing, drain_keeps_retirement_order) {
+  std::vector<int> log;
+  reclamation_queue queue;
+  for (int i = 0; i < 3; ++i) {
+    shared_ptr<ordered>(new ordered(&log, i), deferred_delete<ordered>(queue));
+  }
+  EXPECT_TRUE(log.empty());
+  queue.drain();
+  EXPECT_EQ((std::vector<int>{0, 1, 2}), log);
+}
+
+TEST(deferred_reclaim_testing, drain_follows_nested_retirements) {
+  std::atomic<int> destroyed{0};
+  reclamation_queue queue;
+  struct holder {
+    shared_ptr<tracked> child;
+  };
+  auto parent = make_shared_deferred<holder>(
+      queue, holder{make_shared_deferred<tracked>(queue, &destroyed)});
+  parent.reset();
+  EXPECT_EQ(2, queue.drain());
+  EXPECT_EQ(1, destroyed);
+}
+
+TEST(deferred_reclaim_testing, queue_destructor_drains) {
+  std::atomic<int> destroyed{0};
+  {
+    reclamation_queue queue;
+    make_shared_deferred<tracked>(queue, &destroyed);
+  }
+  EXPECT_EQ(1, destroyed);
+}
+
+TEST(deferred_reclaim_testing, background_reclaimer) {
+  std::atomic<int> destroyed{0};
+  {
+    background_reclaimer reclaimer(std::chrono::microseconds(100));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+      threads.emplace_back([&] {
+        for (int j = 0; j < 1000; ++j) {
+          make_shared_deferred<tracked>(reclaimer.queue(), &destroyed);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    // Only the reclaimer thread destroys anything here.
+    while (destroyed < 4000) {
+      std::this_thread::yield();
+    }
+    EXPECT_TRUE(reclaimer.queue().empty());
+  }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "shared-ptr.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Lock-free list of objects whose destruction was taken off the thread
+// that dropped the last reference. Any thread may retire objects. drain()
+// destroys them in batches, in retirement order, at a point chosen by the
+// application or on a background_reclaimer thread.
+class reclamation_queue {
+public:
+  reclamation_queue() noexcept = default;
+
+  reclamation_queue(const reclamation_queue&) = delete;
+  reclamation_queue& operator=(const reclamation_queue&) = delete;
+
+  // Destroys the object right away if no queue node can be allocated.
+  template <typename T>
+  void retire(T* object) noexcept {
+    node* n;
+    try {
+      n = new node{nullptr, object, &destroy<T>};
+    } catch (...) {
+      destroy<T>(object);
+      return;
+    }
+    n->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(n->next, n, std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+    }
+  }
+
+  // Destroys everything retired so far, including objects retired by the
+  // destructors it runs. Returns how many objects were destroyed.
+  size_t drain() noexcept {
+    size_t destroyed = 0;
+    while (node* batch = head.exchange(nullptr, std::memory_order_acquire)) {
+      node* ordered = nullptr;
+      while (batch) {
+        node* next = batch->next;
+        batch->next = ordered;
+        ordered = batch;
+        batch = next;
+      }
+      while (ordered) {
+        node* next = ordered->next;
+        ordered->destroy(ordered->object);
+        delete ordered;
+        ordered = next;
+        ++destroyed;
+      }
+    }
+    return destroyed;
+  }
+
+  bool empty() const noexcept {
+    return !head.load(std::memory_order_relaxed);
+  }
+
+  ~reclamation_queue() {
+    drain();
+  }
+
+private:
+  struct node {
+    node* next;
+    void* object;
+    void (*destroy)(void*) noexcept;
+  };
+
+  template <typename T>
+  static void destroy(void* object) noexcept {
+    delete static_cast<T*>(object);
+  }
+
+  std::atomic<node*> head{nullptr};
+};
+
+// Deleter that hands the object to a reclamation_queue instead of
+// destroying it. The control block itself is still freed inline.
+template <typename T>
+struct deferred_delete {
+  explicit deferred_delete(reclamation_queue& queue) noexcept
+      : queue(&queue) {}
+
+  void operator()(T* object) const noexcept {
+    queue->retire(object);
+  }
+
+  reclamation_queue* queue;
+};
+
+// Drains a reclamation_queue on its own thread every interval. Stopping
+// the reclaimer drains whatever is left.
+class background_reclaimer {
+public:
+  explicit background_reclaimer(
+      std::chrono::microseconds interval = std::chrono::milliseconds(1))
+      : interval(interval), worker([this] { run(); }) {}
+
+  background_reclaimer(const background_reclaimer&) = delete;
+  background_reclaimer& operator=(const background_reclaimer&) = delete;
+
+  reclamation_queue& queue() noexcept {
+    return pending;
+  }
+
+  ~background_reclaimer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeup.notify_one();
+    worker.join();
+    pending.drain();
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+      wakeup.wait_for(lock, interval);
+      lock.unlock();
+      pending.drain();
+      lock.lock();
+    }
+  }
+
+  reclamation_queue pending;
+  std::chrono::microseconds interval;
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  bool stopping = false;
+  std::thread worker;
+};
+
+// Like make_shared_split(), but the object is destroyed by the queue.
+template <typename T, typename Policy = atomic_policy, typename... Args>
+shared_ptr<T, Policy> make_shared_deferred(reclamation_queue& queue,
+                                           Args&&... args) {
+  return shared_ptr<T, Policy>(new T(std::forward<Args>(args)...),
+                               deferred_delete<T>(queue));
+}
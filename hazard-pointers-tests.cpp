@@ -0,0 +1,82 @@
+#include "hazard-pointers.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+struct tracked {
+  explicit tracked(int* destroyed) : destroyed(destroyed) {}
+
+  ~tracked() {
+    ++*destroyed;
+  }
+
+  int* destroyed;
+};
+} // namespace
+
+TEST(hazard_pointers_testing, retire_unprotected) {
+  int destroyed = 0;
+  hazard_pointers::retire(new tracked(&destroyed));
+  EXPECT_EQ(1, destroyed);
+}
+
+TEST(hazard_pointers_testing, retire_protected) {
+  int destroyed = 0;
+  std::atomic<tracked*> source{new tracked(&destroyed)};
+  {
+    hazard_pointers::hazard hazard;
+    tracked* p = hazard.protect([&] { return source.load(); });
+    source.store(nullptr);
+    hazard_pointers::retire(p);
+    EXPECT_EQ(0, destroyed);
+    EXPECT_EQ(1, hazard_pointers::deferred_size());
+    hazard_pointers::reclaim();
+    EXPECT_EQ(0, destroyed);
+  }
+  hazard_pointers::reclaim();
+  EXPECT_EQ(1, destroyed);
+  EXPECT_EQ(0, hazard_pointers::deferred_size());
+}
+
+TEST(hazard_pointers_testing, nested_beyond_one_record) {
+  int destroyed = 0;
+  std::vector<tracked*> objects;
+  {
+    std::vector<std::unique_ptr<hazard_pointers::hazard>> hazards;
+    for (int i = 0; i != 20; ++i) {
+      objects.push_back(new tracked(&destroyed));
+      hazards.push_back(std::make_unique<hazard_pointers::hazard>());
+      hazards.back()->protect([&] { return objects.back(); });
+    }
+    for (tracked* p : objects) {
+      hazard_pointers::retire(p);
+    }
+    EXPECT_EQ(0, destroyed);
+    // Slots are given back in any order.
+    hazards.erase(hazards.begin());
+    hazard_pointers::reclaim();
+    EXPECT_EQ(1, destroyed);
+    // A slot that was given back can be taken again.
+    hazard_pointers::hazard reused;
+    reused.protect([&] { return objects.back(); });
+  }
+  hazard_pointers::reclaim();
+  EXPECT_EQ(20, destroyed);
+}
+
+TEST(hazard_pointers_testing, retire_from_exiting_threads) {
+  int destroyed = 0;
+  for (int i = 0; i != 8; ++i) {
+    std::thread([&] {
+      hazard_pointers::hazard hazard;
+      tracked* p = new tracked(&destroyed);
+      hazard.protect([&] { return p; });
+      hazard_pointers::retire(p);
+    }).join();
+  }
+  hazard_pointers::reclaim();
+  EXPECT_EQ(8, destroyed);
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Hazard pointers (Michael, 2004) for objects reachable from one atomic
+// word.
+//
+// A reader publishes the address it is about to use in a hazard slot and
+// checks that the word still holds it; after that the object cannot be
+// freed under it. Writers hand unlinked objects to retire(), which frees
+// them right away unless a slot points at them, and keeps them on a
+// deferred list otherwise. Deferred objects are retried on every later
+// retire() and in reclaim().
+//
+// Slots live in records that are never freed. Each thread takes one
+// record on first use and gives it back on exit; a thread nesting more
+// than slots_per_record scopes borrows extra records for them.
+class hazard_pointers {
+  static constexpr unsigned slots_per_record = 8;
+
+  struct record {
+    std::atomic<const void*> slots[slots_per_record] = {};
+    std::atomic<bool> active{false};
+    record* next = nullptr;
+    // Slots in use, only touched by the thread holding the record.
+    unsigned used = 0;
+  };
+
+public:
+  // One published pointer for the lifetime of a scope.
+  class hazard {
+  public:
+    hazard() noexcept {
+      record* cache = thread_record();
+      if (cache->used != full_mask) {
+        index = lowest_free(cache->used);
+        cache->used |= 1u << index;
+        owner = cache;
+      } else {
+        owner = acquire_record();
+        borrowed = true;
+      }
+    }
+
+    hazard(const hazard&) = delete;
+    hazard& operator=(const hazard&) = delete;
+
+    // Publishes what load() returns until two loads in a row agree.
+    template <typename Load>
+    auto protect(Load load) noexcept -> decltype(load()) {
+      auto ptr = load();
+      while (true) {
+        owner->slots[index].store(ptr, std::memory_order_seq_cst);
+        auto again = load();
+        if (again == ptr) {
+          return ptr;
+        }
+        ptr = again;
+      }
+    }
+
+    ~hazard() {
+      owner->slots[index].store(nullptr, std::memory_order_release);
+      if (borrowed) {
+        owner->active.store(false, std::memory_order_release);
+      } else {
+        owner->used &= ~(1u << index);
+      }
+    }
+
+  private:
+    record* owner;
+    unsigned index = 0;
+    bool borrowed = false;
+  };
+
+  // Deletes ptr, which must no longer be reachable from the word readers
+  // protect against, once no hazard points at it.
+  template <typename T>
+  static void retire(T* ptr) noexcept {
+    if (!is_protected(ptr)) {
+      delete ptr;
+    } else {
+      defer(ptr, [](void* p) noexcept { delete static_cast<T*>(p); });
+    }
+    if (deferred_count.load(std::memory_order_relaxed) != 0) {
+      reclaim();
+    }
+  }
+
+  // Frees the deferred objects no hazard points at any more.
+  static void reclaim() noexcept {
+    std::vector<deferred_object> ready;
+    {
+      std::lock_guard<std::mutex> lock(deferred_mutex);
+      auto keep = deferred.begin();
+      for (auto& object : deferred) {
+        if (is_protected(object.ptr)) {
+          *keep++ = object;
+        } else {
+          try {
+            ready.push_back(object);
+          } catch (...) {
+            *keep++ = object;
+          }
+        }
+      }
+      deferred.erase(keep, deferred.end());
+      deferred_count.store(deferred.size(), std::memory_order_relaxed);
+    }
+    // Outside the lock, the destructors may retire more.
+    for (auto& object : ready) {
+      object.destroy(object.ptr);
+    }
+  }
+
+  static size_t deferred_size() noexcept {
+    return deferred_count.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr unsigned full_mask = (1u << slots_per_record) - 1;
+
+  struct deferred_object {
+    void* ptr;
+    void (*destroy)(void*) noexcept;
+  };
+
+  static unsigned lowest_free(unsigned used) noexcept {
+    unsigned index = 0;
+    while (used & (1u << index)) {
+      ++index;
+    }
+    return index;
+  }
+
+  static bool is_protected(const void* ptr) noexcept {
+    for (record* r = records.load(std::memory_order_acquire); r; r = r->next) {
+      for (auto& slot : r->slots) {
+        if (slot.load(std::memory_order_seq_cst) == ptr) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  static void defer(void* ptr, void (*destroy)(void*) noexcept) noexcept {
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(deferred_mutex);
+        try {
+          deferred.push_back({ptr, destroy});
+          deferred_count.store(deferred.size(), std::memory_order_relaxed);
+          return;
+        } catch (...) {
+        }
+      }
+      // Out of memory: hazards are scoped, so this one goes away.
+      if (!is_protected(ptr)) {
+        destroy(ptr);
+        return;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  static record* acquire_record() noexcept {
+    for (record* r = records.load(std::memory_order_acquire); r; r = r->next) {
+      bool expected = false;
+      if (!r->active.load(std::memory_order_relaxed) &&
+          r->active.compare_exchange_strong(expected, true,
+                                            std::memory_order_acquire)) {
+        return r;
+      }
+    }
+    auto* r = new record;
+    r->active.store(true, std::memory_order_relaxed);
+    r->next = records.load(std::memory_order_relaxed);
+    while (!records.compare_exchange_weak(r->next, r,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+    }
+    return r;
+  }
+
+  struct record_holder {
+    ~record_holder() {
+      current->active.store(false, std::memory_order_release);
+      current = nullptr;
+    }
+  };
+
+  static record* thread_record() noexcept {
+    if (!current) {
+      current = acquire_record();
+      static thread_local record_holder holder;
+      (void)holder;
+    }
+    return current;
+  }
+
+  static inline thread_local record* current = nullptr;
+  static inline std::atomic<record*> records{nullptr};
+  static inline std::mutex deferred_mutex;
+  static inline std::vector<deferred_object> deferred;
+  static inline std::atomic<size_t> deferred_count{0};
+};
@@ -0,0 +1,138 @@
+#include "intrusive-ptr.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+struct node : intrusive_ref_counter<node> {
+  explicit node(int value, bool* deleted = nullptr)
+      : value(value), deleted(deleted) {}
+
+  ~node() {
+    if (deleted) {
+      *deleted = true;
+    }
+  }
+
+  int value;
+  bool* deleted;
+};
+
+struct derived_node : node {
+  using node::node;
+};
+
+struct local_node : intrusive_ref_counter<local_node, single_threaded_policy> {
+  int value = 42;
+};
+} // namespace
+
+static_assert(sizeof(intrusive_ptr<node>) == sizeof(node*));
+
+TEST(intrusive_ptr_testing, default_ctor) {
+  intrusive_ptr<node> p;
+  EXPECT_EQ(nullptr, p.get());
+  EXPECT_FALSE(static_cast<bool>(p));
+  EXPECT_EQ(0, p.use_count());
+  EXPECT_TRUE(p == nullptr);
+}
+
+TEST(intrusive_ptr_testing, ptr_ctor) {
+  bool deleted = false;
+  {
+    intrusive_ptr<node> p(new node(42, &deleted));
+    EXPECT_EQ(42, p->value);
+    EXPECT_EQ(1, p.use_count());
+  }
+  EXPECT_TRUE(deleted);
+}
+
+TEST(intrusive_ptr_testing, copy_and_move) {
+  bool deleted = false;
+  {
+    auto p = make_intrusive<node>(42, &deleted);
+    intrusive_ptr<node> q = p;
+    EXPECT_TRUE(p == q);
+    EXPECT_EQ(2, p.use_count());
+    intrusive_ptr<node> r = std::move(q);
+    EXPECT_FALSE(static_cast<bool>(q));
+    EXPECT_EQ(2, r.use_count());
+    p = r;
+    EXPECT_EQ(2, r.use_count());
+    p = std::move(r);
+    EXPECT_EQ(1, p.use_count());
+  }
+  EXPECT_TRUE(deleted);
+}
+
+TEST(intrusive_ptr_testing, reset) {
+  bool first_deleted = false;
+  bool second_deleted = false;
+  intrusive_ptr<node> p(new node(42, &first_deleted));
+  p.reset(new node(43, &second_deleted));
+  EXPECT_TRUE(first_deleted);
+  EXPECT_EQ(43, (*p).value);
+  p.reset();
+  EXPECT_TRUE(second_deleted);
+  EXPECT_FALSE(static_cast<bool>(p));
+}
+
+TEST(intrusive_ptr_testing, adopt_and_detach) {
+  bool deleted = false;
+  intrusive_ptr<node> p(new node(42, &deleted));
+  node* raw = p.detach();
+  EXPECT_FALSE(static_cast<bool>(p));
+  EXPECT_EQ(1, raw->use_count());
+  intrusive_ptr<node> q(raw, false);
+  EXPECT_EQ(1, q.use_count());
+  q.reset();
+  EXPECT_TRUE(deleted);
+}
+
+TEST(intrusive_ptr_testing, conversions_inheritance) {
+  bool deleted = false;
+  {
+    intrusive_ptr<derived_node> d(new derived_node(42, &deleted));
+    intrusive_ptr<node> b = d;
+    EXPECT_EQ(d.get(), b.get());
+    EXPECT_EQ(2, b.use_count());
+    intrusive_ptr<const node> c = std::move(b);
+    EXPECT_EQ(2, c.use_count());
+  }
+  EXPECT_TRUE(deleted);
+}
+
+TEST(intrusive_ptr_testing, copy_does_not_share_count) {
+  auto p = make_intrusive<node>(42);
+  auto q = make_intrusive<node>(*p);
+  EXPECT_EQ(1, p.use_count());
+  EXPECT_EQ(1, q.use_count());
+  EXPECT_FALSE(p == q);
+}
+
+TEST(intrusive_ptr_testing, single_threaded_policy) {
+  auto p = make_intrusive<local_node>();
+  auto q = p;
+  EXPECT_EQ(2, q.use_count());
+  EXPECT_EQ(42, q->value);
+}
+
+TEST(intrusive_ptr_testing, concurrent_copies) {
+  bool deleted = false;
+  {
+    intrusive_ptr<node> p(new node(42, &deleted));
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i != 4; ++i) {
+      threads.emplace_back([p] {
+        for (size_t j = 0; j != 10000; ++j) {
+          intrusive_ptr<node> q = p;
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    EXPECT_EQ(1, p.use_count());
+  }
+  EXPECT_TRUE(deleted);
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "shared-ptr.h"
+
+#include <cstddef>
+#include <utility>
+
+// Base class that stores the reference count inside the object. Counting
+// follows the same policies as shared_ptr. The count is not copied with
+// the object.
+template <typename Derived, typename Policy = atomic_policy>
+class intrusive_ref_counter {
+  static_assert(!has_deferred_release_v<Policy>,
+                "the object cannot be finished outside of release");
+
+public:
+  intrusive_ref_counter() noexcept = default;
+
+  intrusive_ref_counter(const intrusive_ref_counter&) noexcept {}
+
+  intrusive_ref_counter& operator=(const intrusive_ref_counter&) noexcept {
+    return *this;
+  }
+
+  std::size_t use_count() const noexcept {
+    return Policy::load(ref_count);
+  }
+
+  friend void intrusive_ptr_add_ref(const intrusive_ref_counter* p) noexcept {
+    Policy::increment(p->ref_count);
+  }
+
+  friend void intrusive_ptr_release(const intrusive_ref_counter* p) noexcept {
+    if (Policy::decrement(p->ref_count)) {
+      delete static_cast<const Derived*>(p);
+    }
+  }
+
+  friend std::size_t intrusive_ptr_use_count(
+      const intrusive_ref_counter* p) noexcept {
+    return p->use_count();
+  }
+
+protected:
+  ~intrusive_ref_counter() = default;
+
+private:
+  mutable typename Policy::counter ref_count{0};
+};
+
+// Single pointer handle to an object that counts its own references.
+// T must provide intrusive_ptr_add_ref(T*) and intrusive_ptr_release(T*),
+// found by argument-dependent lookup, for example by deriving from
+// intrusive_ref_counter. use_count() additionally needs
+// intrusive_ptr_use_count(T*).
+template <typename T>
+class intrusive_ptr {
+public:
+  template <typename V>
+  friend class intrusive_ptr;
+
+  constexpr intrusive_ptr() noexcept = default;
+
+  constexpr explicit intrusive_ptr(std::nullptr_t) noexcept {}
+
+  // add_ref = false adopts a reference the caller already owns.
+  explicit intrusive_ptr(T* ptr_, bool add_ref = true) noexcept
+      : object_ptr(ptr_) {
+    if (object_ptr && add_ref) {
+      intrusive_ptr_add_ref(object_ptr);
+    }
+  }
+
+  intrusive_ptr(const intrusive_ptr& other) noexcept
+      : intrusive_ptr(other.object_ptr) {}
+
+  template <class V>
+  intrusive_ptr(const intrusive_ptr<V>& other) noexcept
+      : intrusive_ptr(other.object_ptr) {}
+
+  intrusive_ptr(intrusive_ptr&& other) noexcept
+      : object_ptr(other.object_ptr) {
+    other.object_ptr = nullptr;
+  }
+
+  template <class V>
+  intrusive_ptr(intrusive_ptr<V>&& other) noexcept
+      : object_ptr(other.object_ptr) {
+    other.object_ptr = nullptr;
+  }
+
+  intrusive_ptr& operator=(const intrusive_ptr& other) noexcept {
+    intrusive_ptr(other).swap(*this);
+    return *this;
+  }
+
+  intrusive_ptr& operator=(intrusive_ptr&& other) noexcept {
+    intrusive_ptr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  T* get() const noexcept {
+    return object_ptr;
+  }
+
+  operator T*() const noexcept {
+    return object_ptr;
+  }
+
+  bool operator==(const intrusive_ptr& rhs) const noexcept {
+    return rhs.object_ptr == object_ptr;
+  }
+
+  operator bool() const noexcept {
+    return object_ptr;
+  }
+
+  T& operator*() const noexcept {
+    return *object_ptr;
+  }
+
+  T* operator->() const noexcept {
+    return get();
+  }
+
+  std::size_t use_count() const noexcept {
+    if (!object_ptr) {
+      return 0;
+    }
+    return intrusive_ptr_use_count(object_ptr);
+  }
+
+  void reset() noexcept {
+    intrusive_ptr().swap(*this);
+  }
+
+  void reset(T* new_ptr, bool add_ref = true) noexcept {
+    intrusive_ptr(new_ptr, add_ref).swap(*this);
+  }
+
+  // Gives up ownership without releasing the reference.
+  T* detach() noexcept {
+    T* result = object_ptr;
+    object_ptr = nullptr;
+    return result;
+  }
+
+  void swap(intrusive_ptr& other) noexcept {
+    std::swap(object_ptr, other.object_ptr);
+  }
+
+  ~intrusive_ptr() {
+    if (object_ptr) {
+      intrusive_ptr_release(object_ptr);
+    }
+  }
+
+private:
+  T* object_ptr = nullptr;
+};
+
+template <typename T>
+struct is_trivially_relocatable<intrusive_ptr<T>> : std::true_type {};
+
+template <typename T, typename... Args>
+intrusive_ptr<T> make_intrusive(Args&&... args) {
+  return intrusive_ptr<T>(new T(std::forward<Args>(args)...));
+}
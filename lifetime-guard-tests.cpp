@@ -0,0 +1,123 @@
+#include "lifetime-guard.h"
+#include <gtest/gtest.h>
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#include <exception>
+#endif
+
+TEST(lifetime_guard_testing, holds_only_a_weak_reference) {
+  auto owner = make_shared<int>(42);
+  lifetime_guard<int> guard(owner);
+  EXPECT_EQ(1, owner.use_count());
+  EXPECT_FALSE(guard.expired());
+  EXPECT_EQ(42, *guard.lock());
+  EXPECT_EQ(42, *guard.await_resume());
+
+  owner.reset();
+  EXPECT_TRUE(guard.expired());
+  EXPECT_FALSE(guard.lock());
+  EXPECT_THROW(guard.await_resume(), std::bad_weak_ptr);
+}
+
+TEST(lifetime_guard_testing, empty_guard) {
+  lifetime_guard<int> guard;
+  EXPECT_TRUE(guard.expired());
+  EXPECT_TRUE(guard.await_ready());
+  EXPECT_THROW(guard.await_resume(), std::bad_weak_ptr);
+}
+
+// The coroutine tests need a C++20 build, for example with
+// -DCMAKE_CXX_STANDARD=20.
+#ifdef __cpp_impl_coroutine
+namespace {
+// Starts eagerly, records how it ended and frees itself.
+struct detached_task {
+  struct promise_type {
+    bool* cancelled;
+
+    template <typename... Args>
+    promise_type(bool* cancelled, Args&&...) : cancelled(cancelled) {}
+
+    detached_task get_return_object() noexcept {
+      return {};
+    }
+
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+
+    void return_void() noexcept {
+      *cancelled = false;
+    }
+
+    void unhandled_exception() {
+      try {
+        throw;
+      } catch (const std::bad_weak_ptr&) {
+        *cancelled = true;
+      }
+    }
+  };
+};
+
+// Suspends until resume() is called.
+struct event {
+  std::coroutine_handle<> waiter;
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> handle) noexcept {
+    waiter = handle;
+  }
+
+  void await_resume() const noexcept {}
+
+  void resume() {
+    std::exchange(waiter, nullptr).resume();
+  }
+};
+
+detached_task serve(bool* cancelled, lifetime_guard<int> guard, event& wake,
+                    int& seen) {
+  auto self = co_await guard;
+  seen = *self;
+  self.reset();
+  co_await wake;
+  self = co_await guard;
+  seen = *self + 1;
+}
+} // namespace
+
+TEST(lifetime_guard_testing, coroutine_continues_while_owner_lives) {
+  auto owner = make_shared<int>(1);
+  event wake;
+  bool cancelled = true;
+  int seen = 0;
+  serve(&cancelled, owner, wake, seen);
+  EXPECT_EQ(1, seen);
+  // Suspended with a weak reference only.
+  EXPECT_EQ(1, owner.use_count());
+  wake.resume();
+  EXPECT_EQ(2, seen);
+  EXPECT_FALSE(cancelled);
+}
+
+TEST(lifetime_guard_testing, coroutine_is_cancelled_once_owner_is_gone) {
+  auto owner = make_shared<int>(1);
+  event wake;
+  bool cancelled = false;
+  int seen = 0;
+  serve(&cancelled, owner, wake, seen);
+  owner.reset();
+  wake.resume();
+  EXPECT_EQ(1, seen);
+  EXPECT_TRUE(cancelled);
+}
+#endif
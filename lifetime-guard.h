@@ -0,0 +1,62 @@
+#pragma once
+
+#include "shared-ptr.h"
+
+#include <memory>
+#include <utility>
+
+// Keeps a coroutine from holding its owner alive while it is suspended.
+// The guard holds only a weak reference; co_await on it locks the owner
+// for the code that follows:
+//
+//   task connection::serve(lifetime_guard<connection> guard) {
+//     auto request = co_await read_request();
+//     auto self = co_await guard;  // the connection may be gone by now
+//     self->handle(request);
+//   }
+//
+// When the owner is gone, co_await throws std::bad_weak_ptr, which unwinds
+// the coroutine and goes wherever the task type sends its exceptions. The
+// guard never suspends, so it works with any task type. Drop the locked
+// handle before the next suspension point to let teardown proceed.
+template <typename T, typename Policy = atomic_policy>
+class lifetime_guard {
+public:
+  lifetime_guard() noexcept = default;
+
+  lifetime_guard(const weak_ptr<T, Policy>& owner) noexcept : owner(owner) {}
+
+  lifetime_guard(weak_ptr<T, Policy>&& owner) noexcept
+      : owner(std::move(owner)) {}
+
+  lifetime_guard(const shared_ptr<T, Policy>& owner) noexcept
+      : owner(owner) {}
+
+  // The owner, or an empty handle if it is gone.
+  shared_ptr<T, Policy> lock() const noexcept {
+    return owner.lock();
+  }
+
+  bool expired() const noexcept {
+    return owner.expired();
+  }
+
+  // Awaiter interface.
+  bool await_ready() const noexcept {
+    return true;
+  }
+
+  template <typename Handle>
+  void await_suspend(Handle) const noexcept {}
+
+  shared_ptr<T, Policy> await_resume() const {
+    shared_ptr<T, Policy> locked = owner.lock();
+    if (!locked) {
+      throw std::bad_weak_ptr();
+    }
+    return locked;
+  }
+
+private:
+  weak_ptr<T, Policy> owner;
+};
@@ -0,0 +1,121 @@
+#include "sharded-shared-ptr.h"
+#include "tests-extra/test-object.h"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+struct counted {
+  explicit counted(std::atomic<int>* destroyed) : destroyed(destroyed) {}
+
+  ~counted() {
+    destroyed->fetch_add(1);
+  }
+
+  std::atomic<int>* destroyed;
+};
+} // namespace
+
+TEST(sharded_shared_ptr_testing, empty) {
+  sharded_shared_ptr<int> empty;
+  EXPECT_FALSE(empty);
+  EXPECT_EQ(0, empty.shard_count());
+  EXPECT_FALSE(empty.local());
+
+  sharded_shared_ptr<int> from_empty{shared_ptr<int>()};
+  EXPECT_FALSE(from_empty);
+  EXPECT_FALSE(from_empty.local());
+}
+
+TEST(sharded_shared_ptr_testing, holds_one_reference_per_shard) {
+  test_object::no_new_instances_guard g;
+  auto owner = make_shared<test_object>(42);
+  sharded_shared_ptr<test_object> sharded(owner, 4);
+  EXPECT_EQ(4, sharded.shard_count());
+  EXPECT_EQ(5, owner.use_count());
+  EXPECT_EQ(owner.get(), sharded.get());
+  EXPECT_EQ(42, *sharded);
+
+  auto local = sharded.local();
+  EXPECT_EQ(owner.get(), local.get());
+  EXPECT_EQ(2, local.use_count());
+  auto copy = local;
+  EXPECT_EQ(3, local.use_count());
+  EXPECT_EQ(5, owner.use_count());
+
+  sharded.reset();
+  EXPECT_FALSE(sharded);
+  // Only the shard that still has handles keeps its reference.
+  EXPECT_EQ(2, owner.use_count());
+  owner.reset();
+  EXPECT_EQ(42, *copy);
+}
+
+TEST(sharded_shared_ptr_testing, destroys_object_once) {
+  std::atomic<int> destroyed{0};
+  auto sharded = make_shared_sharded<counted>(&destroyed);
+  ASSERT_LE(1, sharded.shard_count());
+  std::vector<shared_ptr<counted>> handles;
+  for (int i = 0; i != 3; ++i) {
+    handles.push_back(sharded.local());
+  }
+  sharded.reset();
+  EXPECT_EQ(0, destroyed);
+  handles.pop_back();
+  EXPECT_EQ(0, destroyed);
+  handles.clear();
+  EXPECT_EQ(1, destroyed);
+}
+
+TEST(sharded_shared_ptr_testing, weak_ptr_of_a_shard) {
+  auto sharded = make_shared_sharded<int>(7);
+  auto local = sharded.local();
+  weak_ptr<int> weak = local;
+  local.reset();
+  EXPECT_EQ(7, *weak.lock());
+  sharded = sharded_shared_ptr<int>();
+  EXPECT_TRUE(weak.expired());
+}
+
+TEST(sharded_shared_ptr_testing, threads_use_their_own_shard) {
+  std::atomic<int> destroyed{0};
+  auto sharded = make_shared_sharded<counted>(&destroyed);
+  std::vector<shared_ptr<counted>> kept(8);
+  std::vector<std::thread> threads;
+  for (auto& slot : kept) {
+    threads.emplace_back([&sharded, &slot] {
+      for (int i = 0; i != 1000; ++i) {
+        auto handle = sharded.local();
+        auto copy = handle;
+      }
+      slot = sharded.local();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  sharded.reset();
+  EXPECT_EQ(0, destroyed);
+  // Handles may be dropped on any thread.
+  std::thread([&kept] { kept.resize(4); }).join();
+  EXPECT_EQ(0, destroyed);
+  kept.clear();
+  EXPECT_EQ(1, destroyed);
+}
+
+TEST(sharded_shared_ptr_testing, move) {
+  auto a = make_shared_sharded<int>(1);
+  auto b = std::move(a);
+  EXPECT_FALSE(a);
+  EXPECT_EQ(1, *b);
+  a = std::move(b);
+  EXPECT_EQ(1, *a.local());
+}
+
+TEST(sharded_shared_ptr_testing, single_threaded_policy) {
+  auto sharded = make_shared_sharded<int, single_threaded_policy>(3);
+  auto local = sharded.local();
+  sharded.reset();
+  EXPECT_EQ(3, *local);
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "shared-ptr.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+template <class T, class Policy>
+struct ShardArena;
+
+// One count shard of a sharded object, on a cache line of its own. It
+// holds one reference to the object, which it gives up once its own count
+// drops to zero.
+template <class T, class Policy>
+struct alignas(cache_line_size) ControlBlockShard : ControlBlock<Policy> {
+  using base = ControlBlock<Policy>;
+
+  ShardArena<T, Policy>* arena;
+  shared_ptr<T, Policy> owner;
+
+  ControlBlockShard(ShardArena<T, Policy>* arena,
+                    const shared_ptr<T, Policy>& owner) noexcept
+      : base(&ops, 1, 1), arena(arena), owner(owner) {}
+
+  static void destroy_object(base* block) noexcept {
+    static_cast<ControlBlockShard*>(block)->owner.reset();
+  }
+
+  static void destroy_block(base* block) noexcept {
+    auto* self = static_cast<ControlBlockShard*>(block);
+    auto* arena = self->arena;
+    self->~ControlBlockShard();
+    arena->release_block();
+  }
+
+  static constexpr typename base::ops_table ops{&destroy_object,
+                                                &destroy_block};
+};
+
+// The shards of one object. live counts the shard blocks that still
+// exist; the last one to go frees them all.
+template <class T, class Policy>
+struct ShardArena {
+  using block_type = ControlBlockShard<T, Policy>;
+
+  std::atomic<size_t> live;
+  size_t size;
+  block_type* blocks = nullptr;
+
+  static ShardArena* create(const shared_ptr<T, Policy>& owner, size_t size) {
+    auto* arena = new ShardArena(size);
+    try {
+      arena->blocks = std::allocator<block_type>().allocate(size);
+    } catch (...) {
+      delete arena;
+      throw;
+    }
+    for (size_t i = 0; i != size; ++i) {
+      ::new (static_cast<void*>(arena->blocks + i)) block_type(arena, owner);
+    }
+    return arena;
+  }
+
+  void release_block() noexcept {
+    if (live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::allocator<block_type>().deallocate(blocks, size);
+      delete this;
+    }
+  }
+
+private:
+  explicit ShardArena(size_t size) : live(size), size(size) {}
+};
+
+// Holder for an object whose handles are copied from many threads at
+// once. local() returns a shared_ptr counted on the calling thread's
+// shard, so that copying and dropping it does not touch the cache lines
+// other threads count on. Threads are assigned to shards round robin.
+//
+// The shared_ptrs it hands out are ordinary ones. A weak_ptr taken from
+// one expires when the holder and every handle of that shard are gone,
+// which may be before the object itself goes away.
+template <typename T, typename Policy = atomic_policy>
+class sharded_shared_ptr {
+public:
+  using element_type = std::remove_extent_t<T>;
+
+  constexpr sharded_shared_ptr() noexcept = default;
+
+  explicit sharded_shared_ptr(const shared_ptr<T, Policy>& owner,
+                              size_t shards = default_shard_count())
+      : object_ptr(owner.get()) {
+    if (owner) {
+      arena = ShardArena<T, Policy>::create(owner, shards ? shards : 1);
+    }
+  }
+
+  sharded_shared_ptr(sharded_shared_ptr&& other) noexcept
+      : arena(std::exchange(other.arena, nullptr)),
+        object_ptr(std::exchange(other.object_ptr, nullptr)) {}
+
+  sharded_shared_ptr& operator=(sharded_shared_ptr&& other) noexcept {
+    sharded_shared_ptr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  ~sharded_shared_ptr() {
+    reset();
+  }
+
+  shared_ptr<T, Policy> local() const noexcept {
+    if (!arena) {
+      return shared_ptr<T, Policy>();
+    }
+    auto* block = arena->blocks + local_index() % arena->size;
+    block->add_shared();
+    return shared_ptr_access::adopt<T, Policy>(block, object_ptr);
+  }
+
+  element_type* get() const noexcept {
+    return object_ptr;
+  }
+
+  element_type& operator*() const noexcept {
+    return *object_ptr;
+  }
+
+  element_type* operator->() const noexcept {
+    return object_ptr;
+  }
+
+  explicit operator bool() const noexcept {
+    return object_ptr;
+  }
+
+  size_t shard_count() const noexcept {
+    return arena ? arena->size : 0;
+  }
+
+  void reset() noexcept {
+    if (!arena) {
+      return;
+    }
+    auto* blocks = arena->blocks;
+    size_t size = arena->size;
+    arena = nullptr;
+    object_ptr = nullptr;
+    for (size_t i = 0; i != size; ++i) {
+      ControlBlock<Policy>* block = blocks + i;
+      if (block->remove_shared()) {
+        ControlBlock<Policy>::release_last_shared(block);
+      }
+    }
+  }
+
+  void swap(sharded_shared_ptr& other) noexcept {
+    std::swap(arena, other.arena);
+    std::swap(object_ptr, other.object_ptr);
+  }
+
+  static size_t default_shard_count() noexcept {
+    unsigned cpus = std::thread::hardware_concurrency();
+    return cpus ? cpus : 1;
+  }
+
+private:
+  static size_t local_index() noexcept {
+    static std::atomic<size_t> next{0};
+    static thread_local size_t index =
+        next.fetch_add(1, std::memory_order_relaxed);
+    return index;
+  }
+
+  ShardArena<T, Policy>* arena = nullptr;
+  element_type* object_ptr = nullptr;
+};
+
+template <typename T, typename Policy = atomic_policy, typename... Args>
+sharded_shared_ptr<T, Policy> make_shared_sharded(Args&&... args) {
+  return sharded_shared_ptr<T, Policy>(
+      make_shared<T, Policy>(std::forward<Args>(args)...));
+}
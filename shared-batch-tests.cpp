@@ -0,0 +1,142 @@
+#include "shared-batch.h"
+#include "tests-extra/test-object.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+struct batch_stats {
+  size_t allocations = 0;
+  size_t deallocations = 0;
+};
+
+template <typename T>
+struct counting_allocator {
+  using value_type = T;
+
+  explicit counting_allocator(batch_stats* stats) : stats(stats) {}
+
+  template <typename U>
+  counting_allocator(const counting_allocator<U>& other)
+      : stats(other.stats) {}
+
+  T* allocate(size_t n) {
+    ++stats->allocations;
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    ++stats->deallocations;
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const counting_allocator<U>& other) const {
+    return stats == other.stats;
+  }
+
+  template <typename U>
+  bool operator!=(const counting_allocator<U>& other) const {
+    return stats != other.stats;
+  }
+
+  batch_stats* stats;
+};
+
+struct throwing_record {
+  explicit throwing_record(int* budget) {
+    if ((*budget)-- == 0) {
+      throw std::runtime_error("out of budget");
+    }
+    ++alive;
+  }
+
+  ~throwing_record() {
+    --alive;
+  }
+
+  static inline int alive = 0;
+};
+} // namespace
+
+TEST(shared_batch_testing, one_allocation) {
+  test_object::no_new_instances_guard g;
+  batch_stats stats;
+  {
+    auto batch = allocate_shared_batch<test_object>(
+        counting_allocator<test_object>(&stats), 1000, 7);
+    ASSERT_EQ(1000, batch.size());
+    EXPECT_EQ(1, stats.allocations);
+    for (auto& p : batch) {
+      EXPECT_EQ(7, *p);
+      EXPECT_EQ(1, p.use_count());
+    }
+    for (size_t i = 1; i != batch.size(); ++i) {
+      EXPECT_LT(batch[i - 1].get(), batch[i].get());
+    }
+    batch.resize(10);
+    EXPECT_EQ(0, stats.deallocations);
+  }
+  EXPECT_EQ(1, stats.deallocations);
+}
+
+TEST(shared_batch_testing, elements_count_separately) {
+  test_object::no_new_instances_guard g;
+  batch_stats stats;
+  weak_ptr<test_object> watched;
+  shared_ptr<test_object> survivor;
+  {
+    auto batch = allocate_shared_batch<test_object>(
+        counting_allocator<test_object>(&stats), 3, 1);
+    watched = batch[0];
+    survivor = batch[2];
+  }
+  EXPECT_TRUE(watched.expired());
+  EXPECT_EQ(1, survivor.use_count());
+  EXPECT_EQ(0, stats.deallocations);
+  survivor.reset();
+  // The weak reference still holds its element block.
+  EXPECT_EQ(0, stats.deallocations);
+  watched = weak_ptr<test_object>();
+  EXPECT_EQ(1, stats.deallocations);
+}
+
+TEST(shared_batch_testing, empty) {
+  batch_stats stats;
+  auto batch = allocate_shared_batch<int>(counting_allocator<int>(&stats), 0);
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(0, stats.allocations);
+}
+
+TEST(shared_batch_testing, constructor_throws) {
+  batch_stats stats;
+  int budget = 5;
+  EXPECT_THROW(allocate_shared_batch<throwing_record>(
+                   counting_allocator<throwing_record>(&stats), 10, &budget),
+               std::runtime_error);
+  EXPECT_EQ(0, throwing_record::alive);
+  EXPECT_EQ(1, stats.allocations);
+  EXPECT_EQ(1, stats.deallocations);
+}
+
+TEST(shared_batch_testing, released_on_other_threads) {
+  auto batch = make_shared_batch<int>(64, 3);
+  std::thread first([part = std::vector<shared_ptr<int>>(
+                         batch.begin(), batch.begin() + 32)]() mutable {
+    part.clear();
+  });
+  std::thread second([part = std::vector<shared_ptr<int>>(
+                          batch.begin() + 32, batch.end())]() mutable {
+    part.clear();
+  });
+  batch.clear();
+  first.join();
+  second.join();
+}
+
+TEST(shared_batch_testing, single_threaded_policy) {
+  auto batch = make_shared_batch<int, single_threaded_policy>(4);
+  EXPECT_EQ(0, *batch[3]);
+  shared_ptr<int, single_threaded_policy> copy = batch[1];
+  EXPECT_EQ(2, copy.use_count());
+}
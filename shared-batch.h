@@ -0,0 +1,166 @@
+#pragma once
+
+#include "shared-ptr.h"
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <class T, class Policy, class Alloc>
+struct BatchArena;
+
+// Control block of one object of a batch. It has its own counts, so the
+// handles of a batch are independent, but its memory belongs to the arena.
+template <class T, class Policy, class Alloc>
+struct ControlBlockInBatch : ControlBlock<Policy> {
+  using base = ControlBlock<Policy>;
+
+  BatchArena<T, Policy, Alloc>* arena;
+  std::aligned_storage_t<sizeof(T), alignof(T)> object_storage;
+
+  explicit ControlBlockInBatch(BatchArena<T, Policy, Alloc>* arena)
+      : base(&ops, 1, 1), arena(arena) {}
+
+  T* object() noexcept {
+    return reinterpret_cast<T*>(&object_storage);
+  }
+
+  static void destroy_object(base* block) noexcept {
+    static_cast<ControlBlockInBatch*>(block)->object()->~T();
+  }
+
+  static void destroy_block(base* block) noexcept {
+    auto* self = static_cast<ControlBlockInBatch*>(block);
+    auto* arena = self->arena;
+    self->~ControlBlockInBatch();
+    arena->release_block();
+  }
+
+  static constexpr typename base::ops_table ops{
+      std::is_trivially_destructible_v<T> ? nullptr : &destroy_object,
+      &destroy_block};
+};
+
+// One allocation holding this header and then size element blocks. live
+// counts the element blocks that still exist; the last one to go frees
+// the arena.
+template <class T, class Policy, class Alloc>
+struct BatchArena : ebo_storage<Alloc, 0> {
+  using block_type = ControlBlockInBatch<T, Policy, Alloc>;
+
+  typename Policy::counter live;
+  size_t size;
+
+  template <class... Args>
+  static BatchArena* create(const Alloc& alloc, size_t size,
+                            const Args&... args) {
+    unit_alloc allocator(alloc);
+    auto* memory = unit_traits::allocate(allocator, units(size));
+    auto* arena = ::new (static_cast<void*>(memory)) BatchArena(alloc, size);
+    size_t constructed = 0;
+    try {
+      for (; constructed != size; ++constructed) {
+        auto* block = ::new (static_cast<void*>(arena->blocks() + constructed))
+            block_type(arena);
+        try {
+          ::new (static_cast<void*>(block->object())) T(args...);
+        } catch (...) {
+          block->~block_type();
+          throw;
+        }
+      }
+    } catch (...) {
+      while (constructed != 0) {
+        block_type* block = arena->blocks() + --constructed;
+        block->object()->~T();
+        block->~block_type();
+      }
+      arena->~BatchArena();
+      unit_traits::deallocate(allocator, memory, units(size));
+      throw;
+    }
+    return arena;
+  }
+
+  block_type* blocks() noexcept {
+    return reinterpret_cast<block_type*>(reinterpret_cast<unsigned char*>(this) +
+                                         blocks_offset());
+  }
+
+  void release_block() noexcept {
+    if (Policy::decrement(live)) {
+      destroy(this);
+    }
+  }
+
+private:
+  static constexpr size_t unit_align =
+      alignof(block_type) > alignof(BatchArena) ? alignof(block_type)
+                                                : alignof(BatchArena);
+
+  struct alignas(unit_align) unit {
+    unsigned char bytes[unit_align];
+  };
+
+  using unit_alloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<unit>;
+  using unit_traits = std::allocator_traits<unit_alloc>;
+
+  static constexpr size_t blocks_offset() noexcept {
+    return (sizeof(BatchArena) + alignof(block_type) - 1) /
+           alignof(block_type) * alignof(block_type);
+  }
+
+  static size_t units(size_t size) noexcept {
+    return (blocks_offset() + size * sizeof(block_type) + sizeof(unit) - 1) /
+           sizeof(unit);
+  }
+
+  BatchArena(const Alloc& alloc, size_t size)
+      : ebo_storage<Alloc, 0>(alloc), live(size), size(size) {
+    if constexpr (has_deferred_release_v<Policy>) {
+      Policy::bind(live, &destroy, this);
+    }
+  }
+
+  static void destroy(void* memory) noexcept {
+    auto* self = static_cast<BatchArena*>(memory);
+    unit_alloc allocator(std::move(self->ebo_storage<Alloc, 0>::get()));
+    size_t count = units(self->size);
+    self->~BatchArena();
+    unit_traits::deallocate(allocator, reinterpret_cast<unit*>(self), count);
+  }
+};
+
+// Creates n objects, each constructed from args, in one allocation and
+// returns one handle per object, in memory order. Every handle counts on
+// its own; the memory goes back to alloc once all objects and their weak
+// references are gone.
+template <typename T, typename Policy = atomic_policy, typename Alloc,
+          typename... Args>
+std::vector<shared_ptr<T, Policy>> allocate_shared_batch(const Alloc& alloc,
+                                                         size_t n,
+                                                         const Args&... args) {
+  static_assert(!std::is_array_v<T>, "batches hold single objects");
+  std::vector<shared_ptr<T, Policy>> handles;
+  if (n == 0) {
+    return handles;
+  }
+  handles.reserve(n);
+  auto* arena = BatchArena<T, Policy, Alloc>::create(alloc, n, args...);
+  for (size_t i = 0; i != n; ++i) {
+    auto* block = arena->blocks() + i;
+    handles.push_back(
+        shared_ptr_access::adopt_new<T, Policy>(block, block->object()));
+  }
+  return handles;
+}
+
+template <typename T, typename Policy = atomic_policy, typename... Args>
+std::vector<shared_ptr<T, Policy>> make_shared_batch(size_t n,
+                                                     const Args&... args) {
+  return allocate_shared_batch<T, Policy>(std::allocator<T>(), n, args...);
+}
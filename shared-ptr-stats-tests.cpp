@@ -0,0 +1,94 @@
+#include "shared-ptr.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+// The statistics change the control block layout, so they are only
+// tested when the whole build defines SHARED_PTR_STATISTICS.
+#ifdef SHARED_PTR_STATISTICS
+namespace {
+template <int Id>
+struct counted {
+  int value = Id;
+};
+
+struct base {
+  virtual ~base() = default;
+};
+
+struct derived : base {};
+} // namespace
+
+TEST(shared_ptr_stats_testing, allocations_and_live) {
+  using T = counted<0>;
+  {
+    auto a = make_shared<T>();
+    shared_ptr<T> b(new T);
+    auto c = make_shared<T>();
+    c.reset();
+    auto stats = type_statistics::of<T>().collect();
+    EXPECT_EQ(3, stats.allocations);
+    EXPECT_EQ(2, stats.live);
+    EXPECT_EQ(3, stats.peak_live);
+  }
+  auto stats = type_statistics::of<T>().collect();
+  EXPECT_EQ(0, stats.live);
+  EXPECT_EQ(3, stats.peak_live);
+}
+
+TEST(shared_ptr_stats_testing, copies_and_moves) {
+  using T = counted<1>;
+  auto a = make_shared<T>();
+  shared_ptr<T> b = a;
+  shared_ptr<T> c;
+  c = b;
+  shared_ptr<T> d = std::move(b);
+  c = std::move(d);
+  auto stats = type_statistics::of<T>().collect();
+  EXPECT_EQ(2, stats.copies);
+  EXPECT_EQ(2, stats.moves);
+}
+
+TEST(shared_ptr_stats_testing, locks) {
+  using T = counted<2>;
+  auto a = make_shared<T>();
+  weak_ptr<T> w = a;
+  EXPECT_TRUE(w.lock());
+  a.reset();
+  EXPECT_FALSE(w.lock());
+  EXPECT_FALSE(w.lock());
+  auto stats = type_statistics::of<T>().collect();
+  EXPECT_EQ(1, stats.lock_hits);
+  EXPECT_EQ(2, stats.lock_misses);
+}
+
+TEST(shared_ptr_stats_testing, attributed_to_created_type) {
+  shared_ptr<base> b = make_shared<derived>();
+  shared_ptr<base> copy = b;
+  EXPECT_EQ(1, type_statistics::of<derived>().collect().copies);
+  EXPECT_EQ(0, type_statistics::of<base>().collect().allocations);
+}
+
+TEST(shared_ptr_stats_testing, summed_over_threads) {
+  using T = counted<3>;
+  auto a = make_shared<T>();
+  std::vector<std::thread> threads;
+  for (int i = 0; i != 4; ++i) {
+    threads.emplace_back([&a] {
+      for (int j = 0; j != 100; ++j) {
+        shared_ptr<T> copy = a;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(400, type_statistics::of<T>().collect().copies);
+
+  bool found = false;
+  for (auto& stats : type_statistics::collect_all()) {
+    found = found || stats.type == typeid(T).name();
+  }
+  EXPECT_TRUE(found);
+}
+#endif
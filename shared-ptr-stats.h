@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+// Statistics of the objects of one type that shared_ptr manages, summed
+// over all threads. Events are attributed to the type the object was
+// created with, whatever handle type later refers to it.
+struct handle_statistics {
+  std::string type;
+  size_t allocations = 0;
+  size_t copies = 0;
+  size_t moves = 0;
+  size_t lock_hits = 0;
+  size_t lock_misses = 0;
+  size_t live = 0;
+  size_t peak_live = 0;
+};
+
+// Collected when SHARED_PTR_STATISTICS is defined. Each thread counts into
+// its own shard per type, with plain loads and stores, and collect() sums
+// the shards up. The live count is shared by all threads of a type because
+// the peak needs one running total; it only changes when objects are
+// created or destroyed. Shards of exited threads are taken over by new
+// threads and keep their counts.
+class type_statistics {
+public:
+  template <typename T>
+  static type_statistics& of() {
+    static type_statistics stats(typeid(T).name());
+    return stats;
+  }
+
+  type_statistics(const type_statistics&) = delete;
+  type_statistics& operator=(const type_statistics&) = delete;
+
+  void object_created() noexcept {
+    local_shard().add(allocations);
+    size_t now = live.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t peak = peak_live.load(std::memory_order_relaxed);
+    while (peak < now && !peak_live.compare_exchange_weak(
+                             peak, now, std::memory_order_relaxed)) {
+    }
+  }
+
+  void object_destroyed() noexcept {
+    live.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void copied() noexcept {
+    local_shard().add(copies);
+  }
+
+  void moved() noexcept {
+    local_shard().add(moves);
+  }
+
+  void locked(bool hit) noexcept {
+    local_shard().add(hit ? lock_hits : lock_misses);
+  }
+
+  handle_statistics collect() const {
+    handle_statistics result;
+    result.type = name;
+    size_t sums[counter_count] = {};
+    for (shard* s = shards.load(std::memory_order_acquire); s; s = s->next) {
+      for (size_t i = 0; i != counter_count; ++i) {
+        sums[i] += s->counters[i].load(std::memory_order_relaxed);
+      }
+    }
+    result.allocations = sums[allocations];
+    result.copies = sums[copies];
+    result.moves = sums[moves];
+    result.lock_hits = sums[lock_hits];
+    result.lock_misses = sums[lock_misses];
+    result.live = live.load(std::memory_order_relaxed);
+    result.peak_live = peak_live.load(std::memory_order_relaxed);
+    return result;
+  }
+
+  // Every type that was used so far.
+  static std::vector<handle_statistics> collect_all() {
+    std::vector<handle_statistics> result;
+    for (type_statistics* t = types.load(std::memory_order_acquire); t;
+         t = t->next_type) {
+      result.push_back(t->collect());
+    }
+    return result;
+  }
+
+private:
+  enum counter_index {
+    allocations,
+    copies,
+    moves,
+    lock_hits,
+    lock_misses,
+    counter_count
+  };
+
+  struct shard {
+    std::atomic<size_t> counters[counter_count] = {};
+    std::atomic<bool> in_use{true};
+    shard* next = nullptr;
+
+    void add(counter_index i) noexcept {
+      counters[i].store(counters[i].load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+    }
+  };
+
+  struct thread_shards {
+    std::vector<shard*> by_type;
+
+    ~thread_shards() {
+      for (shard* s : by_type) {
+        if (s) {
+          s->in_use.store(false, std::memory_order_release);
+        }
+      }
+    }
+  };
+
+  explicit type_statistics(const char* name)
+      : name(name), index(type_count.fetch_add(1, std::memory_order_relaxed)) {
+    next_type = types.load(std::memory_order_relaxed);
+    while (!types.compare_exchange_weak(next_type, this,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+  }
+
+  shard& local_shard() noexcept {
+    auto& by_type = local.by_type;
+    if (index < by_type.size() && by_type[index]) {
+      return *by_type[index];
+    }
+    return attach_shard();
+  }
+
+  // Statistics are best effort: without memory for the bookkeeping the
+  // event is dropped.
+  shard& attach_shard() noexcept {
+    shard* s = nullptr;
+    for (shard* candidate = shards.load(std::memory_order_acquire); candidate;
+         candidate = candidate->next) {
+      bool expected = false;
+      if (!candidate->in_use.load(std::memory_order_relaxed) &&
+          candidate->in_use.compare_exchange_strong(
+              expected, true, std::memory_order_acquire)) {
+        s = candidate;
+        break;
+      }
+    }
+    try {
+      if (!s) {
+        s = new shard;
+        s->next = shards.load(std::memory_order_relaxed);
+        while (!shards.compare_exchange_weak(s->next, s,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+        }
+      }
+      if (local.by_type.size() <= index) {
+        local.by_type.resize(index + 1);
+      }
+      local.by_type[index] = s;
+      return *s;
+    } catch (...) {
+      if (s) {
+        s->in_use.store(false, std::memory_order_release);
+      }
+      static shard dropped;
+      return dropped;
+    }
+  }
+
+  const char* name;
+  size_t index;
+  std::atomic<shard*> shards{nullptr};
+  std::atomic<size_t> live{0};
+  std::atomic<size_t> peak_live{0};
+  type_statistics* next_type = nullptr;
+
+  static inline std::atomic<type_statistics*> types{nullptr};
+  static inline std::atomic<size_t> type_count{0};
+  static inline thread_local thread_shards local;
+};
@@ -1,98 +1,622 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
+#ifdef SHARED_PTR_POOL_CONTROL_BLOCKS
+#include "control-block-pool.h"
+#endif
+
+#ifdef SHARED_PTR_STATISTICS
+#include "shared-ptr-stats.h"
+#endif
+
+#ifdef SHARED_PTR_TRACK_BLOCKS
+#include "block-registry.h"
+#endif
+
+// Keeps rarely taken paths out of line, so that the common one inlines.
+#if defined(__GNUC__) || defined(__clang__)
+#define SHARED_PTR_COLD __attribute__((noinline, cold))
+#elif defined(_MSC_VER)
+#define SHARED_PTR_COLD __declspec(noinline)
+#else
+#define SHARED_PTR_COLD
+#endif
+
+// Reference counting policies. A policy describes the counter type stored
+// in the control block and how it is incremented and decremented.
+//
+// A policy that may only notice a zero count later, outside of decrement(),
+// sets deferred_release and provides bind(counter&, on_zero, context). The
+// control block then hands each counter the function that finishes it.
+struct atomic_policy {
+  using counter = std::atomic<size_t>;
+
+  static void increment(counter& cnt) noexcept {
+    cnt.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Returns true if the counter dropped to zero.
+  static bool decrement(counter& cnt) noexcept {
+    // acq_rel rather than release plus a fence: same code on x86 and
+    // understood by ThreadSanitizer.
+    return cnt.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+  static bool increment_if_not_zero(counter& cnt) noexcept {
+    size_t value = cnt.load(std::memory_order_relaxed);
+    do {
+      if (value == 0) {
+        return false;
+      }
+    } while (!cnt.compare_exchange_weak(value, value + 1,
+                                        std::memory_order_relaxed));
+    return true;
+  }
+
+  static size_t load(const counter& cnt) noexcept {
+    return cnt.load(std::memory_order_relaxed);
+  }
+};
+
+// Plain counters for handles that never leave one thread.
+struct single_threaded_policy {
+  using counter = size_t;
+
+  static void increment(counter& cnt) noexcept {
+    cnt++;
+  }
+
+  static bool decrement(counter& cnt) noexcept {
+    return --cnt == 0;
+  }
+
+  static bool increment_if_not_zero(counter& cnt) noexcept {
+    if (cnt == 0) {
+      return false;
+    }
+    cnt++;
+    return true;
+  }
+
+  static size_t load(const counter& cnt) noexcept {
+    return cnt;
+  }
+};
+
+template <typename Policy, typename = void>
+struct has_deferred_release : std::false_type {};
+
+template <typename Policy>
+struct has_deferred_release<Policy, std::void_t<decltype(Policy::deferred_release)>>
+    : std::bool_constant<Policy::deferred_release> {};
+
+template <typename Policy>
+inline constexpr bool has_deferred_release_v = has_deferred_release<Policy>::value;
+
+// Whether a T may be moved to another address by copying its bytes,
+// without running its destructor at the old one. The handles of this
+// library specialize it; containers query it through
+// uninitialized_relocate().
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <typename T>
+inline constexpr bool is_trivially_relocatable_v =
+    is_trivially_relocatable<T>::value;
+
+// Moves the objects in [first, last) to the uninitialized memory at dest
+// and ends their lifetime at the old place. Returns the end of the
+// destination range.
+template <typename T>
+T* uninitialized_relocate(T* first, T* last, T* dest) noexcept {
+  static_assert(is_trivially_relocatable_v<T> ||
+                    std::is_nothrow_move_constructible_v<T>,
+                "relocation must not throw");
+  if constexpr (is_trivially_relocatable_v<T>) {
+    if (first != last) {
+      std::memcpy(static_cast<void*>(dest), static_cast<const void*>(first),
+                  (last - first) * sizeof(T));
+    }
+    return dest + (last - first);
+  } else {
+    for (; first != last; ++first, ++dest) {
+      ::new (static_cast<void*>(dest)) T(std::move(*first));
+      first->~T();
+    }
+    return dest;
+  }
+}
+
+// weak_ptr_cnt counts weak references plus one for all shared references
+// together, as long as any exist. Copying or dropping a shared_ptr only
+// touches shared_ptr_cnt.
+//
+// The block is not polymorphic. Each concrete block type has one static
+// ops table, and a null destroy_object entry means there is nothing to
+// run when the last shared reference goes away.
+template <typename Policy>
 struct ControlBlock {
-  size_t weak_ptr_cnt;
-  size_t shared_ptr_cnt;
+  struct ops_table {
+    void (*destroy_object)(ControlBlock*) noexcept;
+    // Destroys the block and frees it with the allocator it came from.
+    void (*destroy_block)(ControlBlock*) noexcept;
+  };
 
-  ControlBlock(size_t weak_ptr_cnt, size_t shared_ptr_cnt)
-      : weak_ptr_cnt(weak_ptr_cnt), shared_ptr_cnt(shared_ptr_cnt) {}
+  const ops_table* ops;
+  typename Policy::counter weak_ptr_cnt;
+  typename Policy::counter shared_ptr_cnt;
+#ifdef SHARED_PTR_STATISTICS
+  // Statistics of the type the object was created with.
+  type_statistics* stats = nullptr;
+#endif
+#ifdef SHARED_PTR_TRACK_BLOCKS
+  // Entry in block_registry while the object lives.
+  tracked_object tracking;
+#endif
 
-  void add_shared() {
-    weak_ptr_cnt++;
-    shared_ptr_cnt++;
+  ControlBlock(const ops_table* ops, size_t weak_ptr_cnt,
+               size_t shared_ptr_cnt)
+      : ops(ops), weak_ptr_cnt(weak_ptr_cnt), shared_ptr_cnt(shared_ptr_cnt) {
+    if constexpr (has_deferred_release_v<Policy>) {
+      Policy::bind(this->weak_ptr_cnt, &release_last_weak, this);
+      Policy::bind(this->shared_ptr_cnt, &release_last_shared, this);
+    }
   }
 
-  void remove_shared() {
-    weak_ptr_cnt--;
-    shared_ptr_cnt--;
+  void add_shared() noexcept {
+    Policy::increment(shared_ptr_cnt);
+#ifdef SHARED_PTR_STATISTICS
+    if (stats) {
+      stats->copied();
+    }
+#endif
   }
 
-  void add_weak() {
-    weak_ptr_cnt++;
+  // Used by weak_ptr::lock(): takes a shared reference unless the object
+  // is already gone. The caller's weak reference keeps the block alive.
+  bool try_add_shared() noexcept {
+    bool added = Policy::increment_if_not_zero(shared_ptr_cnt);
+#ifdef SHARED_PTR_STATISTICS
+    if (stats) {
+      stats->locked(added);
+    }
+#endif
+    return added;
   }
 
-  void remove_weak() {
-    weak_ptr_cnt--;
+  // Returns true if it was the last shared reference. The caller then
+  // destroys the object and drops the weak reference of the shared group
+  // with remove_weak().
+  bool remove_shared() noexcept {
+    return Policy::decrement(shared_ptr_cnt);
   }
 
-  virtual ~ControlBlock() {}
+  void add_weak() noexcept {
+    Policy::increment(weak_ptr_cnt);
+  }
+
+  // Returns true if it was the last reference of any kind.
+  bool remove_weak() noexcept {
+    return Policy::decrement(weak_ptr_cnt);
+  }
 
-  virtual void deleteObjectPtr() = 0;
+  size_t use_count() const noexcept {
+    return Policy::load(shared_ptr_cnt);
+  }
+
+  // Destroys the object and drops the weak reference of the shared group.
+  SHARED_PTR_COLD static void release_last_shared(void* block) noexcept {
+    auto* self = static_cast<ControlBlock*>(block);
+    self->deleteObjectPtr();
+    if (self->remove_weak()) {
+      self->deleteControlBlock();
+    }
+  }
+
+  static void release_last_weak(void* block) noexcept {
+    static_cast<ControlBlock*>(block)->deleteControlBlock();
+  }
+
+  // Called once the object of type V is in place, records it when
+  // SHARED_PTR_STATISTICS or SHARED_PTR_TRACK_BLOCKS is defined.
+  template <typename V>
+  void track_new(const std::remove_extent_t<V>* object) noexcept {
+#ifdef SHARED_PTR_STATISTICS
+    stats = &type_statistics::of<V>();
+    stats->object_created();
+#endif
+#ifdef SHARED_PTR_TRACK_BLOCKS
+    block_registry::add<V>(tracking, this, object, &tracked_use_count);
+#endif
+    (void)object;
+  }
+
+  void track_move() noexcept {
+#ifdef SHARED_PTR_STATISTICS
+    if (stats) {
+      stats->moved();
+    }
+#endif
+  }
+
+  void deleteObjectPtr() noexcept {
+#ifdef SHARED_PTR_STATISTICS
+    if (stats) {
+      stats->object_destroyed();
+    }
+#endif
+#ifdef SHARED_PTR_TRACK_BLOCKS
+    block_registry::remove(tracking);
+#endif
+    if (ops->destroy_object) {
+      ops->destroy_object(this);
+    }
+  }
+
+  void deleteControlBlock() noexcept {
+    ops->destroy_block(this);
+  }
+
+#ifdef SHARED_PTR_TRACK_BLOCKS
+  static size_t tracked_use_count(const void* block) noexcept {
+    return static_cast<const ControlBlock*>(block)->use_count();
+  }
+#endif
 };
 
-template <class T, class Deleter>
-struct ControlBlockWithPointer : ControlBlock {
-  T* object_ptr;
-  Deleter deleter;
-  ControlBlockWithPointer(T* object_ptr, Deleter deleter)
-      : ControlBlock(1, 1), object_ptr(object_ptr), deleter(deleter) {}
+// Holds a possibly empty member without spending space on it when the
+// type is empty. Index tells apart several such bases of one class.
+template <class T, int Index, bool = std::is_empty_v<T> && !std::is_final_v<T>>
+struct ebo_storage {
+  explicit ebo_storage(T value) : value(std::move(value)) {}
+
+  T& get() noexcept {
+    return value;
+  }
 
-  void deleteObjectPtr() override {
-    this->deleter(object_ptr);
-    object_ptr = nullptr;
+private:
+  T value;
+};
+
+template <class T, int Index>
+struct ebo_storage<T, Index, true> : private T {
+  explicit ebo_storage(T value) : T(std::move(value)) {}
+
+  T& get() noexcept {
+    return *this;
   }
 };
 
+// Allocates Block through a rebound copy of alloc. The block receives the
+// allocator as its first constructor argument and gives the memory back
+// in deleteControlBlock().
+template <class Block, class Alloc, class... Args>
+Block* allocate_control_block(const Alloc& alloc, Args&&... args) {
+  using block_alloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<Block>;
+  using traits = std::allocator_traits<block_alloc>;
+  block_alloc allocator(alloc);
+  Block* block = traits::allocate(allocator, 1);
+  try {
+    ::new (static_cast<void*>(block)) Block(alloc, std::forward<Args>(args)...);
+  } catch (...) {
+    traits::deallocate(allocator, block, 1);
+    throw;
+  }
+  return block;
+}
+
+template <class Block, class Alloc>
+void deallocate_control_block(Block* block, Alloc& alloc) noexcept {
+  using block_alloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<Block>;
+  block_alloc allocator(std::move(alloc));
+  block->~Block();
+  std::allocator_traits<block_alloc>::deallocate(allocator, block, 1);
+}
+
+// Allocator used for the control block when a raw pointer is handed to
+// shared_ptr without one.
+#ifdef SHARED_PTR_POOL_CONTROL_BLOCKS
+template <class T>
+using default_control_block_allocator = control_block_pool_allocator<T>;
+#else
 template <class T>
-struct ControlBlockWithValue : ControlBlock {
-  std::aligned_storage_t<sizeof(T), alignof(T)> object_storage;
+using default_control_block_allocator = std::allocator<T>;
+#endif
+
+// The allocator and the deleter take no space when they are empty, as
+// they are for the default ones. std::default_delete is not even called
+// through: the block deletes the object itself.
+template <class T, class Deleter, class Policy, class Alloc = std::allocator<T>>
+struct ControlBlockWithPointer : ControlBlock<Policy>,
+                                 ebo_storage<Alloc, 0>,
+                                 ebo_storage<Deleter, 1> {
+  using base = ControlBlock<Policy>;
+
+  T* object_ptr;
+
+  ControlBlockWithPointer(const Alloc& alloc, T* object_ptr, Deleter&& deleter)
+      : base(&ops, 1, 1), ebo_storage<Alloc, 0>(alloc),
+        ebo_storage<Deleter, 1>(std::move(deleter)), object_ptr(object_ptr) {}
+
+  static void destroy_object(base* block) noexcept {
+    auto* self = static_cast<ControlBlockWithPointer*>(block);
+    if constexpr (std::is_same_v<Deleter, std::default_delete<T>>) {
+      delete self->object_ptr;
+    } else if constexpr (std::is_same_v<Deleter, std::default_delete<T[]>>) {
+      delete[] self->object_ptr;
+    } else {
+      self->ebo_storage<Deleter, 1>::get()(self->object_ptr);
+    }
+    self->object_ptr = nullptr;
+  }
+
+  static void destroy_block(base* block) noexcept {
+    auto* self = static_cast<ControlBlockWithPointer*>(block);
+    Alloc alloc(std::move(self->ebo_storage<Alloc, 0>::get()));
+    deallocate_control_block(self, alloc);
+  }
+
+  static constexpr typename base::ops_table ops{&destroy_object,
+                                                &destroy_block};
+};
+
+// Selects default-initialization in the make_shared_for_overwrite family.
+struct for_overwrite_t {
+  explicit for_overwrite_t() = default;
+};
+
+// Selects the layout of make_shared(cache_aligned, ...): the object starts
+// on its own cache line, away from the counters.
+struct cache_aligned_t {
+  explicit cache_aligned_t() = default;
+};
+
+inline constexpr cache_aligned_t cache_aligned{};
+
+// Stands in for std::hardware_destructive_interference_size, whose value
+// GCC warns may differ between translation units. Define it to 128 for
+// CPUs that prefetch cache lines in pairs.
+#ifndef SHARED_PTR_CACHE_LINE_SIZE
+#define SHARED_PTR_CACHE_LINE_SIZE 64
+#endif
+
+inline constexpr size_t cache_line_size = SHARED_PTR_CACHE_LINE_SIZE;
+
+template <class T, class Policy, class Alloc = std::allocator<T>,
+          size_t Align = alignof(T)>
+struct ControlBlockWithValue : ControlBlock<Policy>, ebo_storage<Alloc, 0> {
+  using base = ControlBlock<Policy>;
+
+  std::aligned_storage_t<sizeof(T), Align> object_storage;
 
   template <class... Args>
-  ControlBlockWithValue(Args... args)
-      : ControlBlock(1, 1) {
+  explicit ControlBlockWithValue(const Alloc& alloc, Args&&... args)
+      : base(&ops, 1, 1), ebo_storage<Alloc, 0>(alloc) {
     ::new (&object_storage) T(std::forward<Args>(args)...);
   }
 
-  void deleteObjectPtr() override {
-    reinterpret_cast<T*>(&object_storage)->~T();
+  ControlBlockWithValue(const Alloc& alloc, for_overwrite_t)
+      : base(&ops, 1, 1), ebo_storage<Alloc, 0>(alloc) {
+    ::new (&object_storage) T;
   }
 
-  ~ControlBlockWithValue() {
+  static void destroy_object(base* block) noexcept {
+    auto* self = static_cast<ControlBlockWithValue*>(block);
+    reinterpret_cast<T*>(&self->object_storage)->~T();
+  }
 
+  static void destroy_block(base* block) noexcept {
+    auto* self = static_cast<ControlBlockWithValue*>(block);
+    Alloc alloc(std::move(self->ebo_storage<Alloc, 0>::get()));
+    deallocate_control_block(self, alloc);
   }
+
+  static constexpr typename base::ops_table ops{
+      std::is_trivially_destructible_v<T> ? nullptr : &destroy_object,
+      &destroy_block};
 };
 
-template <typename T>
+// Control block followed by size elements of E in the same allocation.
+template <class E, class Policy, class Alloc>
+struct ControlBlockWithArray : ControlBlock<Policy>, ebo_storage<Alloc, 0> {
+  using base = ControlBlock<Policy>;
+
+  size_t size;
+
+  // Value-initializes with no initializer, default-initializes with
+  // for_overwrite_t and copies otherwise.
+  template <class... Init>
+  static ControlBlockWithArray* create(const Alloc& alloc, size_t size,
+                                       const Init&... init) {
+    if (size > (SIZE_MAX - elements_offset() - sizeof(unit)) / sizeof(E)) {
+      throw std::bad_array_new_length();
+    }
+    unit_alloc allocator(alloc);
+    auto* memory = unit_traits::allocate(allocator, units(size));
+    auto* block = ::new (static_cast<void*>(memory))
+        ControlBlockWithArray(alloc, size);
+    E* first = block->elements();
+    size_t constructed = 0;
+    try {
+      for (; constructed != size; ++constructed) {
+        construct(first + constructed, init...);
+      }
+    } catch (...) {
+      destroy_elements(first, constructed);
+      block->~ControlBlockWithArray();
+      unit_traits::deallocate(allocator, memory, units(size));
+      throw;
+    }
+    return block;
+  }
+
+  E* elements() noexcept {
+    return reinterpret_cast<E*>(reinterpret_cast<unsigned char*>(this) +
+                                elements_offset());
+  }
+
+  static void destroy_object(base* block) noexcept {
+    auto* self = static_cast<ControlBlockWithArray*>(block);
+    destroy_elements(self->elements(), self->size);
+  }
+
+  static void destroy_block(base* block) noexcept {
+    auto* self = static_cast<ControlBlockWithArray*>(block);
+    unit_alloc allocator(std::move(self->ebo_storage<Alloc, 0>::get()));
+    size_t count = units(self->size);
+    self->~ControlBlockWithArray();
+    unit_traits::deallocate(allocator, reinterpret_cast<unit*>(self), count);
+  }
+
+  static constexpr typename base::ops_table ops{
+      std::is_trivially_destructible_v<E> ? nullptr : &destroy_object,
+      &destroy_block};
+
+private:
+  static constexpr size_t unit_align =
+      alignof(E) > alignof(base) ? alignof(E) : alignof(base);
+
+  struct alignas(unit_align) unit {
+    unsigned char bytes[unit_align];
+  };
+
+  using unit_alloc =
+      typename std::allocator_traits<Alloc>::template rebind_alloc<unit>;
+  using unit_traits = std::allocator_traits<unit_alloc>;
+
+  static constexpr size_t elements_offset() noexcept {
+    return (sizeof(ControlBlockWithArray) + alignof(E) - 1) / alignof(E) *
+           alignof(E);
+  }
+
+  ControlBlockWithArray(const Alloc& alloc, size_t size)
+      : base(&ops, 1, 1), ebo_storage<Alloc, 0>(alloc), size(size) {}
+
+  static size_t units(size_t size) noexcept {
+    return (elements_offset() + size * sizeof(E) + sizeof(unit) - 1) /
+           sizeof(unit);
+  }
+
+  static void construct(E* p) {
+    ::new (static_cast<void*>(p)) E();
+  }
+
+  static void construct(E* p, for_overwrite_t) {
+    ::new (static_cast<void*>(p)) E;
+  }
+
+  static void construct(E* p, const E& value) {
+    ::new (static_cast<void*>(p)) E(value);
+  }
+
+  static void destroy_elements(E* first, size_t count) noexcept {
+    while (count != 0) {
+      first[--count].~E();
+    }
+  }
+};
+
+template <typename T, typename Policy = atomic_policy>
 class weak_ptr;
 
-template<typename T>
+template <typename T, typename Policy = atomic_policy>
 class shared_ptr;
 
+// Lets factory functions hand a freshly created control block, which
+// already holds one shared reference, to a shared_ptr.
+struct shared_ptr_access {
+  template <typename T, typename Policy>
+  static shared_ptr<T, Policy> adopt(ControlBlock<Policy>* block,
+                                     std::remove_extent_t<T>* ptr) noexcept;
+
+  // adopt() for a block whose object was just created, which also links
+  // an enable_shared_from_this base to it.
+  template <typename T, typename Policy>
+  static shared_ptr<T, Policy> adopt_new(ControlBlock<Policy>* block,
+                                         std::remove_extent_t<T>* ptr) noexcept;
+
+  template <typename T, typename Policy>
+  static ControlBlock<Policy>* block(const shared_ptr<T, Policy>& shared) noexcept;
+
+  // Empties a handle without dropping its reference and returns its block.
+  template <typename T, typename Policy>
+  static ControlBlock<Policy>* release(shared_ptr<T, Policy>& shared) noexcept;
+};
+
+template <typename T, typename Policy = atomic_policy>
+class enable_shared_from_this;
+
+// Finds the enable_shared_from_this<U, Policy> base of a type, if it has
+// exactly one: the return type is U* then, and void otherwise.
+template <typename Policy, typename U>
+U* shared_from_this_base(const enable_shared_from_this<U, Policy>*);
+
+template <typename Policy>
+void shared_from_this_base(...);
+
+// Deleter used when a raw pointer is handed to shared_ptr<T> without one.
+template <typename T, typename V>
+using default_deleter_t =
+    std::conditional_t<std::is_array_v<T>, std::default_delete<T>,
+                       std::default_delete<V>>;
+
 template <typename T>
+class atomic_shared_ptr;
+
+template <typename T, typename Policy>
 class shared_ptr {
 public:
-  friend class weak_ptr<T>;
+  friend class weak_ptr<T, Policy>;
 
-  template <typename V, typename... Args>
-  friend shared_ptr<V> make_shared(Args&&... args);
+  friend struct shared_ptr_access;
 
-  template <typename Y>
+  template <typename Y, typename P>
   friend class shared_ptr;
 
-  shared_ptr() noexcept = default;
+  template <typename Y>
+  friend class atomic_shared_ptr;
+
+  using element_type = std::remove_extent_t<T>;
 
-  explicit shared_ptr(std::nullptr_t) noexcept {}
+  constexpr shared_ptr() noexcept = default;
 
-  template<typename V, typename  Deleter = std::default_delete<V>>
-  explicit shared_ptr(V* ptr_, Deleter deleter = std::default_delete<V>())
-      : object_ptr(ptr_),
-        control_block_ptr(new ControlBlockWithPointer{ptr_, deleter}) {}
+  constexpr explicit shared_ptr(std::nullptr_t) noexcept {}
+
+  template<typename V, typename  Deleter = default_deleter_t<T, V>>
+  explicit shared_ptr(V* ptr_, Deleter deleter = Deleter())
+      : shared_ptr(ptr_, std::move(deleter),
+                   default_control_block_allocator<V>()) {}
+
+  // The control block is allocated with alloc. If that throws, ptr_ is
+  // passed to the deleter before the exception propagates.
+  template <typename V, typename Deleter, typename Alloc>
+  shared_ptr(V* ptr_, Deleter deleter, const Alloc& alloc)
+      : object_ptr(ptr_) {
+    try {
+      control_block_ptr =
+          allocate_control_block<ControlBlockWithPointer<V, Deleter, Policy, Alloc>>(
+              alloc, ptr_, std::move(deleter));
+    } catch (...) {
+      deleter(ptr_);
+      throw;
+    }
+    control_block_ptr->template track_new<V>(ptr_);
+    enable_weak_this(ptr_);
+  }
 
   template<typename V>
-  shared_ptr(const shared_ptr<V>& other, T* object_ptr) : object_ptr(object_ptr), control_block_ptr(other.control_block_ptr) {
+  shared_ptr(const shared_ptr<V, Policy>& other, element_type* object_ptr) noexcept : object_ptr(object_ptr), control_block_ptr(other.control_block_ptr) {
     if (control_block_ptr != nullptr) {
       control_block_ptr->add_shared();
     }
@@ -105,7 +629,7 @@ public:
   }
 
   template<class V>
-  shared_ptr(const shared_ptr<V>& other) noexcept : object_ptr(other.object_ptr), control_block_ptr(other.control_block_ptr) {
+  shared_ptr(const shared_ptr<V, Policy>& other) noexcept : object_ptr(other.object_ptr), control_block_ptr(other.control_block_ptr) {
     if (control_block_ptr != nullptr) {
       control_block_ptr->add_shared();
     }
@@ -116,84 +640,147 @@ public:
         control_block_ptr(other.control_block_ptr) {
     other.object_ptr = nullptr;
     other.control_block_ptr = nullptr;
+    track_move();
+  }
+
+  template <class V>
+  shared_ptr(shared_ptr<V, Policy>&& other) noexcept
+      : object_ptr(other.object_ptr),
+        control_block_ptr(other.control_block_ptr) {
+    other.object_ptr = nullptr;
+    other.control_block_ptr = nullptr;
+    track_move();
+  }
+
+  // Takes over the reference of other instead of adding one.
+  template <class V>
+  shared_ptr(shared_ptr<V, Policy>&& other, element_type* object_ptr) noexcept
+      : object_ptr(object_ptr), control_block_ptr(other.control_block_ptr) {
+    other.object_ptr = nullptr;
+    other.control_block_ptr = nullptr;
+    track_move();
   }
 
+  // Takes the new reference before dropping the old one, since other may
+  // live in the object that is released.
   shared_ptr& operator=(const shared_ptr& other) noexcept {
-    if (this == &other) {
-      return *this;
-    }
-    clear_ptr();
-    this->object_ptr = other.object_ptr;
-    this->control_block_ptr = other.control_block_ptr;
-    if (control_block_ptr) {
-      control_block_ptr->add_shared();
-    }
+    shared_ptr(other).swap(*this);
     return *this;
   }
 
   shared_ptr& operator=(shared_ptr&& other) noexcept {
-    if (this == &other) {
-      return *this;
-    }
-    clear_ptr();
+    shared_ptr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  template <class V>
+  shared_ptr& operator=(const shared_ptr<V, Policy>& other) noexcept {
+    shared_ptr(other).swap(*this);
+    return *this;
+  }
+
+  template <class V>
+  shared_ptr& operator=(shared_ptr<V, Policy>&& other) noexcept {
+    shared_ptr(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  void swap(shared_ptr& other) noexcept {
     std::swap(control_block_ptr, other.control_block_ptr);
     std::swap(object_ptr, other.object_ptr);
-    return *this;
   }
 
-  T* get() const noexcept {
+  constexpr element_type* get() const noexcept {
     return object_ptr;
   }
 
-  operator T*() const noexcept {
+  constexpr operator element_type*() const noexcept {
     return object_ptr;
   }
 
-  bool operator==(const shared_ptr& rhs) {
+  // Handles are equal when they share ownership, like owner_equal().
+  bool operator==(const shared_ptr& rhs) const noexcept {
     return rhs.control_block_ptr == control_block_ptr;
   }
 
-  operator bool() const noexcept {
+  bool operator!=(const shared_ptr& rhs) const noexcept {
+    return rhs.control_block_ptr != control_block_ptr;
+  }
+
+  // Ownership based ordering, equality and hash: aliases of one object
+  // and weak_ptrs to it compare equal, whatever they point to, and an
+  // expired weak_ptr keeps its place.
+  template <class V>
+  bool owner_before(const shared_ptr<V, Policy>& other) const noexcept {
+    return std::less<const void*>()(control_block_ptr, other.control_block_ptr);
+  }
+
+  template <class V>
+  bool owner_before(const weak_ptr<V, Policy>& other) const noexcept {
+    return std::less<const void*>()(control_block_ptr, other.control_block_ptr);
+  }
+
+  template <class V>
+  bool owner_equal(const shared_ptr<V, Policy>& other) const noexcept {
+    return control_block_ptr == other.control_block_ptr;
+  }
+
+  template <class V>
+  bool owner_equal(const weak_ptr<V, Policy>& other) const noexcept {
+    return control_block_ptr == other.control_block_ptr;
+  }
+
+  size_t owner_hash() const noexcept {
+    return std::hash<const void*>()(control_block_ptr);
+  }
+
+  constexpr operator bool() const noexcept {
     return object_ptr;
   }
 
-  T& operator*() const noexcept {
+  constexpr element_type& operator*() const noexcept {
     return *object_ptr;
   }
 
-  T* operator->() const noexcept {
+  constexpr element_type* operator->() const noexcept {
     return get();
   }
 
+  // Only meaningful for shared_ptr<T[]>.
+  constexpr element_type& operator[](std::ptrdiff_t i) const noexcept {
+    return object_ptr[i];
+  }
+
   std::size_t use_count() const noexcept {
     if (!control_block_ptr) {
       return 0;
     }
-    return control_block_ptr->shared_ptr_cnt;
+    return control_block_ptr->use_count();
   }
 
   void reset() noexcept {
     clear_ptr();
   }
 
-  template<class V, class Deleter = std::default_delete<V>>
-  void reset(V* new_ptr, Deleter deleter = std::default_delete<V>()) {
-    reset();
-    object_ptr = new_ptr;
-    control_block_ptr = new ControlBlockWithPointer{new_ptr, deleter};
+  template<class V, class Deleter = default_deleter_t<T, V>>
+  void reset(V* new_ptr, Deleter deleter = Deleter()) {
+    reset(new_ptr, std::move(deleter), default_control_block_allocator<V>());
   }
 
-  void clear_ptr() {
+  template <class V, class Deleter, class Alloc>
+  void reset(V* new_ptr, Deleter deleter, const Alloc& alloc) {
+    *this = shared_ptr(new_ptr, std::move(deleter), alloc);
+  }
+
+  // Empties the handle before destroying the object, which may own it.
+  void clear_ptr() noexcept {
     if (control_block_ptr) {
-      control_block_ptr->remove_shared();
-      if (control_block_ptr->shared_ptr_cnt == 0) {
-        control_block_ptr->deleteObjectPtr();
-      }
-      if (control_block_ptr->weak_ptr_cnt == 0) {
-        delete control_block_ptr;
-      }
+      auto* block = control_block_ptr;
       control_block_ptr = nullptr;
       object_ptr = nullptr;
+      if (block->remove_shared()) {
+        ControlBlock<Policy>::release_last_shared(block);
+      }
     }
   }
 
@@ -202,29 +789,103 @@ public:
   }
 
 private:
-  T* object_ptr = nullptr;
-  ControlBlock* control_block_ptr = nullptr;
+  void track_move() noexcept {
+#ifdef SHARED_PTR_STATISTICS
+    if (control_block_ptr) {
+      control_block_ptr->track_move();
+    }
+#endif
+  }
+
+  // Points the weak reference inside an enable_shared_from_this base at
+  // this control block, unless it already has an owner.
+  template <typename V>
+  void enable_weak_this(V* ptr) noexcept {
+    using base = std::remove_pointer_t<
+        decltype(shared_from_this_base<Policy>(std::declval<V*>()))>;
+    if constexpr (!std::is_void_v<base>) {
+      auto* object = const_cast<base*>(static_cast<const base*>(ptr));
+      if (object && object->weak_this.expired()) {
+        object->weak_this.assign(control_block_ptr, object);
+      }
+    }
+  }
+
+  element_type* object_ptr = nullptr;
+  ControlBlock<Policy>* control_block_ptr = nullptr;
 };
 
-template <typename T>
+// Whether Base is a virtual base of Derived. Converting a Derived* to
+// such a base reads the object, so it must not be done once it is gone.
+template <typename Base, typename Derived, typename = void>
+struct is_virtual_base_of
+    : std::is_base_of<std::remove_cv_t<Base>, std::remove_cv_t<Derived>> {};
+
+template <typename Base, typename Derived>
+struct is_virtual_base_of<
+    Base, Derived,
+    std::void_t<decltype(static_cast<std::remove_cv_t<Derived>*>(
+        std::declval<std::remove_cv_t<Base>*>()))>> : std::false_type {};
+
+template <typename Base, typename Derived>
+inline constexpr bool is_virtual_base_of_v =
+    is_virtual_base_of<Base, Derived>::value;
+
+template <typename T, typename Policy>
 class weak_ptr {
 public:
-  weak_ptr() noexcept = default;
+  template <typename Y, typename P>
+  friend class shared_ptr;
+
+  template <typename Y, typename P>
+  friend class weak_ptr;
+
+  using element_type = std::remove_extent_t<T>;
 
-  weak_ptr(const shared_ptr<T>& other) noexcept
+  constexpr weak_ptr() noexcept = default;
+
+  weak_ptr(const shared_ptr<T, Policy>& other) noexcept
       : control_block_ptr(other.control_block_ptr), object_ptr(other.get()) {
     if (other.control_block_ptr) {
       other.control_block_ptr->add_weak();
     }
   }
 
-  weak_ptr(const weak_ptr<T>& other) noexcept : control_block_ptr(other.control_block_ptr), object_ptr(other.object_ptr) {
+  weak_ptr(const weak_ptr<T, Policy>& other) noexcept : control_block_ptr(other.control_block_ptr), object_ptr(other.object_ptr) {
     if (other.control_block_ptr) {
       other.control_block_ptr->add_weak();
     }
   }
 
-  weak_ptr& operator=(const weak_ptr<T>& other) noexcept {
+  template <class V, typename = std::enable_if_t<std::is_convertible_v<
+                         typename weak_ptr<V, Policy>::element_type*,
+                         element_type*>>>
+  weak_ptr(const weak_ptr<V, Policy>& other) noexcept
+      : control_block_ptr(other.control_block_ptr),
+        object_ptr(convert(other)) {
+    if (control_block_ptr) {
+      control_block_ptr->add_weak();
+    }
+  }
+
+  weak_ptr(weak_ptr<T, Policy>&& other) noexcept
+      : control_block_ptr(other.control_block_ptr),
+        object_ptr(other.object_ptr) {
+    other.control_block_ptr = nullptr;
+    other.object_ptr = nullptr;
+  }
+
+  template <class V, typename = std::enable_if_t<std::is_convertible_v<
+                         typename weak_ptr<V, Policy>::element_type*,
+                         element_type*>>>
+  weak_ptr(weak_ptr<V, Policy>&& other) noexcept
+      : control_block_ptr(other.control_block_ptr),
+        object_ptr(convert(other)) {
+    other.control_block_ptr = nullptr;
+    other.object_ptr = nullptr;
+  }
+
+  weak_ptr& operator=(const weak_ptr<T, Policy>& other) noexcept {
     if (control_block_ptr == other.control_block_ptr) {
       return *this;
     }
@@ -237,7 +898,7 @@ public:
     return *this;
   }
 
-  weak_ptr& operator=(weak_ptr<T>&& other) noexcept {
+  weak_ptr& operator=(weak_ptr<T, Policy>&& other) noexcept {
     if (control_block_ptr == other.control_block_ptr) {
       return *this;
     }
@@ -247,7 +908,7 @@ public:
     return *this;
   }
 
-  weak_ptr& operator=(const shared_ptr<T>& other) noexcept {
+  weak_ptr& operator=(const shared_ptr<T, Policy>& other) noexcept {
     if (control_block_ptr == other.control_block_ptr) {
       return *this;
     }
@@ -260,23 +921,62 @@ public:
     return *this;
   }
 
-  shared_ptr<T> lock() const noexcept {
-    if (!control_block_ptr ||
-        control_block_ptr->shared_ptr_cnt == 0) {
-      return shared_ptr<T>(nullptr);
+  std::size_t use_count() const noexcept {
+    if (!control_block_ptr) {
+      return 0;
     }
-    auto shared = shared_ptr<T>(nullptr);
-    shared.object_ptr = object_ptr;
-    shared.control_block_ptr = control_block_ptr;
-    control_block_ptr->add_shared();
-    return shared;
+    return control_block_ptr->use_count();
+  }
+
+  bool expired() const noexcept {
+    return use_count() == 0;
+  }
+
+  bool operator==(const weak_ptr& rhs) const noexcept {
+    return rhs.control_block_ptr == control_block_ptr;
+  }
+
+  bool operator!=(const weak_ptr& rhs) const noexcept {
+    return rhs.control_block_ptr != control_block_ptr;
+  }
+
+  template <class V>
+  bool owner_before(const shared_ptr<V, Policy>& other) const noexcept {
+    return std::less<const void*>()(control_block_ptr,
+                                    shared_ptr_access::block(other));
+  }
+
+  template <class V>
+  bool owner_before(const weak_ptr<V, Policy>& other) const noexcept {
+    return std::less<const void*>()(control_block_ptr,
+                                    other.control_block_ptr);
+  }
+
+  template <class V>
+  bool owner_equal(const shared_ptr<V, Policy>& other) const noexcept {
+    return control_block_ptr == shared_ptr_access::block(other);
+  }
+
+  template <class V>
+  bool owner_equal(const weak_ptr<V, Policy>& other) const noexcept {
+    return control_block_ptr == other.control_block_ptr;
   }
 
-  void clear_ptr() {
+  size_t owner_hash() const noexcept {
+    return std::hash<const void*>()(control_block_ptr);
+  }
+
+  shared_ptr<T, Policy> lock() const noexcept {
+    if (!control_block_ptr || !control_block_ptr->try_add_shared()) {
+      return shared_ptr<T, Policy>(nullptr);
+    }
+    return shared_ptr_access::adopt<T, Policy>(control_block_ptr, object_ptr);
+  }
+
+  void clear_ptr() noexcept {
     if (control_block_ptr) {
-      control_block_ptr->remove_weak();
-      if (control_block_ptr->weak_ptr_cnt == 0) {
-        delete control_block_ptr;
+      if (control_block_ptr->remove_weak()) {
+        control_block_ptr->deleteControlBlock();
       }
       control_block_ptr = nullptr;
       object_ptr = nullptr;
@@ -288,15 +988,346 @@ public:
   }
 
 private:
-  ControlBlock * control_block_ptr = nullptr;
-  T* object_ptr = nullptr;
+  void assign(ControlBlock<Policy>* block, element_type* ptr) noexcept {
+    clear_ptr();
+    control_block_ptr = block;
+    object_ptr = ptr;
+    control_block_ptr->add_weak();
+  }
+
+  // The pointer of other as an element_type*. A virtual base is found
+  // through the live object, so an expired handle converts to null.
+  template <class V>
+  static element_type* convert(const weak_ptr<V, Policy>& other) noexcept {
+    using from = typename weak_ptr<V, Policy>::element_type;
+    if constexpr (is_virtual_base_of_v<element_type, from>) {
+      return other.lock().get();
+    } else {
+      return other.object_ptr;
+    }
+  }
+
+  ControlBlock<Policy>* control_block_ptr = nullptr;
+  element_type* object_ptr = nullptr;
 };
 
-template <typename T, typename... Args>
-shared_ptr<T> make_shared(Args&&... args) {
-  auto controlBlock = new ControlBlockWithValue<T>(args...);
-  auto shared = shared_ptr<T>(nullptr);
-  shared.control_block_ptr = controlBlock;
-  shared.object_ptr = reinterpret_cast<T*>(&controlBlock->object_storage);
+// Neither handle points into itself, so both may be moved with memcpy.
+template <typename T, typename Policy>
+struct is_trivially_relocatable<shared_ptr<T, Policy>> : std::true_type {};
+
+template <typename T, typename Policy>
+struct is_trivially_relocatable<weak_ptr<T, Policy>> : std::true_type {};
+
+// Function objects for ownership based containers of handles, such as
+// std::map<weak_ptr<T>, V, owner_less<>> or
+// std::unordered_map<weak_ptr<T>, V, owner_hash, owner_equal>. They accept
+// any mix of shared_ptr and weak_ptr.
+template <typename T = void>
+struct owner_less {
+  template <typename A, typename B>
+  bool operator()(const A& a, const B& b) const noexcept {
+    return a.owner_before(b);
+  }
+
+  using is_transparent = void;
+};
+
+struct owner_hash {
+  template <typename H>
+  size_t operator()(const H& handle) const noexcept {
+    return handle.owner_hash();
+  }
+
+  using is_transparent = void;
+};
+
+struct owner_equal {
+  template <typename A, typename B>
+  bool operator()(const A& a, const B& b) const noexcept {
+    return a.owner_equal(b);
+  }
+
+  using is_transparent = void;
+};
+
+// Consistent with operator==, which compares ownership.
+namespace std {
+template <typename T, typename Policy>
+struct hash<::shared_ptr<T, Policy>> {
+  size_t operator()(const ::shared_ptr<T, Policy>& handle) const noexcept {
+    return handle.owner_hash();
+  }
+};
+
+template <typename T, typename Policy>
+struct hash<::weak_ptr<T, Policy>> {
+  size_t operator()(const ::weak_ptr<T, Policy>& handle) const noexcept {
+    return handle.owner_hash();
+  }
+};
+} // namespace std
+
+// Lets an object owned by shared_ptr hand out further shared_ptrs to
+// itself. The weak reference is set by the shared_ptr constructors,
+// reset() and the make_shared family, and does not need an allocation.
+template <typename T, typename Policy>
+class enable_shared_from_this {
+public:
+  template <typename Y, typename P>
+  friend class shared_ptr;
+
+  // Throws std::bad_weak_ptr if the object is not owned by a shared_ptr.
+  shared_ptr<T, Policy> shared_from_this() {
+    return lock_this<T>();
+  }
+
+  shared_ptr<const T, Policy> shared_from_this() const {
+    return lock_this<const T>();
+  }
+
+  weak_ptr<T, Policy> weak_from_this() noexcept {
+    return weak_this;
+  }
+
+  weak_ptr<const T, Policy> weak_from_this() const noexcept {
+    return weak_this;
+  }
+
+protected:
+  enable_shared_from_this() noexcept = default;
+
+  // A copy belongs to whoever owns it, not to the owner of the original.
+  enable_shared_from_this(const enable_shared_from_this&) noexcept {}
+
+  enable_shared_from_this& operator=(const enable_shared_from_this&) noexcept {
+    return *this;
+  }
+
+  ~enable_shared_from_this() = default;
+
+private:
+  template <typename U>
+  shared_ptr<U, Policy> lock_this() const {
+    shared_ptr<U, Policy> shared = weak_this.lock();
+    if (!shared) {
+      throw std::bad_weak_ptr();
+    }
+    return shared;
+  }
+
+  mutable weak_ptr<T, Policy> weak_this;
+};
+
+template <typename T, typename Policy>
+shared_ptr<T, Policy> shared_ptr_access::adopt(
+    ControlBlock<Policy>* block, std::remove_extent_t<T>* ptr) noexcept {
+  auto shared = shared_ptr<T, Policy>(nullptr);
+  shared.control_block_ptr = block;
+  shared.object_ptr = ptr;
+  return shared;
+}
+
+template <typename T, typename Policy>
+shared_ptr<T, Policy> shared_ptr_access::adopt_new(
+    ControlBlock<Policy>* block, std::remove_extent_t<T>* ptr) noexcept {
+  block->template track_new<T>(ptr);
+  auto shared = adopt<T, Policy>(block, ptr);
+  shared.enable_weak_this(ptr);
   return shared;
 }
+
+template <typename T, typename Policy>
+ControlBlock<Policy>* shared_ptr_access::block(
+    const shared_ptr<T, Policy>& shared) noexcept {
+  return shared.control_block_ptr;
+}
+
+template <typename T, typename Policy>
+ControlBlock<Policy>* shared_ptr_access::release(
+    shared_ptr<T, Policy>& shared) noexcept {
+  ControlBlock<Policy>* block = shared.control_block_ptr;
+  shared.control_block_ptr = nullptr;
+  shared.object_ptr = nullptr;
+  return block;
+}
+
+// Pointer casts. The rvalue overloads take over the reference of the
+// source instead of adding one. dynamic_pointer_cast leaves the source
+// untouched when the cast fails.
+template <typename T, typename U, typename Policy>
+shared_ptr<T, Policy> static_pointer_cast(
+    const shared_ptr<U, Policy>& other) noexcept {
+  using E = typename shared_ptr<T, Policy>::element_type;
+  return shared_ptr<T, Policy>(other, static_cast<E*>(other.get()));
+}
+
+template <typename T, typename U, typename Policy>
+shared_ptr<T, Policy> static_pointer_cast(
+    shared_ptr<U, Policy>&& other) noexcept {
+  using E = typename shared_ptr<T, Policy>::element_type;
+  E* ptr = static_cast<E*>(other.get());
+  return shared_ptr<T, Policy>(std::move(other), ptr);
+}
+
+template <typename T, typename U, typename Policy>
+shared_ptr<T, Policy> dynamic_pointer_cast(
+    const shared_ptr<U, Policy>& other) noexcept {
+  using E = typename shared_ptr<T, Policy>::element_type;
+  if (E* ptr = dynamic_cast<E*>(other.get())) {
+    return shared_ptr<T, Policy>(other, ptr);
+  }
+  return shared_ptr<T, Policy>();
+}
+
+template <typename T, typename U, typename Policy>
+shared_ptr<T, Policy> dynamic_pointer_cast(
+    shared_ptr<U, Policy>&& other) noexcept {
+  using E = typename shared_ptr<T, Policy>::element_type;
+  if (E* ptr = dynamic_cast<E*>(other.get())) {
+    return shared_ptr<T, Policy>(std::move(other), ptr);
+  }
+  return shared_ptr<T, Policy>();
+}
+
+template <typename T, typename U, typename Policy>
+shared_ptr<T, Policy> const_pointer_cast(
+    const shared_ptr<U, Policy>& other) noexcept {
+  using E = typename shared_ptr<T, Policy>::element_type;
+  return shared_ptr<T, Policy>(other, const_cast<E*>(other.get()));
+}
+
+template <typename T, typename U, typename Policy>
+shared_ptr<T, Policy> const_pointer_cast(
+    shared_ptr<U, Policy>&& other) noexcept {
+  using E = typename shared_ptr<T, Policy>::element_type;
+  E* ptr = const_cast<E*>(other.get());
+  return shared_ptr<T, Policy>(std::move(other), ptr);
+}
+
+template <typename T>
+constexpr bool is_unbounded_array_v =
+    std::is_array_v<T> && std::extent_v<T> == 0;
+
+template <typename T, typename Policy = atomic_policy, typename Alloc,
+          typename... Args>
+std::enable_if_t<!std::is_array_v<T>, shared_ptr<T, Policy>>
+allocate_shared(const Alloc& alloc, Args&&... args) {
+  auto controlBlock =
+      allocate_control_block<ControlBlockWithValue<T, Policy, Alloc>>(
+          alloc, std::forward<Args>(args)...);
+  return shared_ptr_access::adopt_new<T, Policy>(
+      controlBlock, reinterpret_cast<T*>(&controlBlock->object_storage));
+}
+
+// The counters and the object go on separate cache lines, so that writes
+// to the object do not slow down copies of handles on other threads, and
+// the reverse. The block grows to at least two cache lines.
+template <typename T, typename Policy = atomic_policy, typename Alloc,
+          typename... Args>
+std::enable_if_t<!std::is_array_v<T>, shared_ptr<T, Policy>>
+allocate_shared(const Alloc& alloc, cache_aligned_t, Args&&... args) {
+  constexpr size_t align =
+      alignof(T) < cache_line_size ? cache_line_size : alignof(T);
+  auto controlBlock =
+      allocate_control_block<ControlBlockWithValue<T, Policy, Alloc, align>>(
+          alloc, std::forward<Args>(args)...);
+  return shared_ptr_access::adopt_new<T, Policy>(
+      controlBlock, reinterpret_cast<T*>(&controlBlock->object_storage));
+}
+
+// Allocates the object apart from the control block, so its memory is
+// returned as soon as the last shared_ptr is gone even if weak_ptrs keep
+// the control block alive. Costs a second allocation.
+template <typename T, typename Policy = atomic_policy, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, shared_ptr<T, Policy>>
+make_shared_split(Args&&... args) {
+  return shared_ptr<T, Policy>(new T(std::forward<Args>(args)...));
+}
+
+// Defining SHARED_PTR_SPLIT_THRESHOLD (in bytes, the same for the whole
+// program) makes make_shared split objects at least that large.
+template <typename T, typename Policy = atomic_policy, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, shared_ptr<T, Policy>>
+make_shared(Args&&... args) {
+#ifdef SHARED_PTR_SPLIT_THRESHOLD
+  if constexpr (sizeof(T) >= SHARED_PTR_SPLIT_THRESHOLD) {
+    return make_shared_split<T, Policy>(std::forward<Args>(args)...);
+  }
+#endif
+  return allocate_shared<T, Policy>(std::allocator<T>(),
+                                    std::forward<Args>(args)...);
+}
+
+template <typename T, typename Policy = atomic_policy, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, shared_ptr<T, Policy>>
+make_shared(cache_aligned_t, Args&&... args) {
+  return allocate_shared<T, Policy>(std::allocator<T>(), cache_aligned,
+                                    std::forward<Args>(args)...);
+}
+
+// Leaves the object default-initialized, which for trivial types means
+// uninitialized.
+template <typename T, typename Policy = atomic_policy, typename Alloc>
+std::enable_if_t<!std::is_array_v<T>, shared_ptr<T, Policy>>
+allocate_shared_for_overwrite(const Alloc& alloc) {
+  return allocate_shared<T, Policy>(alloc, for_overwrite_t());
+}
+
+template <typename T, typename Policy = atomic_policy>
+std::enable_if_t<!std::is_array_v<T>, shared_ptr<T, Policy>>
+make_shared_for_overwrite() {
+  return allocate_shared_for_overwrite<T, Policy>(std::allocator<T>());
+}
+
+// Array forms: one allocation holds the control block and all n elements.
+template <typename T, typename Policy = atomic_policy, typename Alloc,
+          typename... Init>
+std::enable_if_t<is_unbounded_array_v<T>, shared_ptr<T, Policy>>
+allocate_shared_array(const Alloc& alloc, size_t n, const Init&... init) {
+  using E = std::remove_extent_t<T>;
+  auto controlBlock =
+      ControlBlockWithArray<E, Policy, Alloc>::create(alloc, n, init...);
+  controlBlock->template track_new<T>(controlBlock->elements());
+  return shared_ptr_access::adopt<T, Policy>(controlBlock,
+                                             controlBlock->elements());
+}
+
+template <typename T, typename Policy = atomic_policy, typename Alloc>
+std::enable_if_t<is_unbounded_array_v<T>, shared_ptr<T, Policy>>
+allocate_shared(const Alloc& alloc, size_t n) {
+  return allocate_shared_array<T, Policy>(alloc, n);
+}
+
+template <typename T, typename Policy = atomic_policy, typename Alloc>
+std::enable_if_t<is_unbounded_array_v<T>, shared_ptr<T, Policy>>
+allocate_shared(const Alloc& alloc, size_t n,
+                const std::remove_extent_t<T>& value) {
+  return allocate_shared_array<T, Policy>(alloc, n, value);
+}
+
+template <typename T, typename Policy = atomic_policy>
+std::enable_if_t<is_unbounded_array_v<T>, shared_ptr<T, Policy>>
+make_shared(size_t n) {
+  return allocate_shared<T, Policy>(std::allocator<std::remove_extent_t<T>>(),
+                                    n);
+}
+
+template <typename T, typename Policy = atomic_policy>
+std::enable_if_t<is_unbounded_array_v<T>, shared_ptr<T, Policy>>
+make_shared(size_t n, const std::remove_extent_t<T>& value) {
+  return allocate_shared<T, Policy>(std::allocator<std::remove_extent_t<T>>(),
+                                    n, value);
+}
+
+template <typename T, typename Policy = atomic_policy, typename Alloc>
+std::enable_if_t<is_unbounded_array_v<T>, shared_ptr<T, Policy>>
+allocate_shared_for_overwrite(const Alloc& alloc, size_t n) {
+  return allocate_shared_array<T, Policy>(alloc, n, for_overwrite_t());
+}
+
+template <typename T, typename Policy = atomic_policy>
+std::enable_if_t<is_unbounded_array_v<T>, shared_ptr<T, Policy>>
+make_shared_for_overwrite(size_t n) {
+  return allocate_shared_for_overwrite<T, Policy>(
+      std::allocator<std::remove_extent_t<T>>(), n);
+}
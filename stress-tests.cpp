@@ -0,0 +1,236 @@
+#include "atomic-shared-ptr.h"
+#include "biased-policy.h"
+#include "shared-ptr.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Many threads doing random operations on shared handles. Build the
+// stress-tests target in Debug to run it under the thread sanitizer and
+// in Release to compare the reported throughput between versions.
+// SHARED_PTR_STRESS_ITERATIONS scales the operations per thread.
+namespace {
+constexpr uint32_t alive_magic = 0x5eed5eed;
+
+// Counts its instances and detects use after destruction.
+struct payload {
+  explicit payload(uint32_t value) : value(value) {
+    created.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  ~payload() {
+    magic.store(0, std::memory_order_relaxed);
+    destroyed.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint32_t check() const {
+    EXPECT_EQ(alive_magic, magic.load(std::memory_order_relaxed));
+    return value;
+  }
+
+  std::atomic<uint32_t> magic{alive_magic};
+  uint32_t value;
+
+  static inline std::atomic<size_t> created{0};
+  static inline std::atomic<size_t> destroyed{0};
+};
+
+size_t thread_count() {
+  return std::max<size_t>(4, 2 * std::thread::hardware_concurrency());
+}
+
+size_t iterations() {
+  if (const char* env = std::getenv("SHARED_PTR_STRESS_ITERATIONS")) {
+    return std::strtoul(env, nullptr, 10);
+  }
+  return 200000;
+}
+
+// Runs body(thread index, random engine) on every thread at once and
+// reports the operations per second over all of them.
+template <typename Body>
+void run_threads(const char* name, size_t threads, Body body) {
+  std::atomic<bool> go{false};
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i != threads; ++i) {
+    workers.emplace_back([&, i] {
+      std::minstd_rand random(static_cast<uint32_t>(i) * 7919 + 1);
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      body(i, random);
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  double ops = static_cast<double>(threads * iterations()) / elapsed.count();
+  std::cout << "[ stress   ] " << name << ": " << threads << " threads, "
+            << static_cast<uint64_t>(ops) << " ops/s" << std::endl;
+  ::testing::Test::RecordProperty("ops_per_second",
+                                  std::to_string(static_cast<uint64_t>(ops)));
+}
+
+class stress_testing : public ::testing::Test {
+protected:
+  void SetUp() override {
+    created_before = payload::created.load();
+    destroyed_before = payload::destroyed.load();
+  }
+
+  void expect_all_destroyed() {
+    EXPECT_EQ(payload::created.load() - created_before,
+              payload::destroyed.load() - destroyed_before);
+  }
+
+  size_t created_before = 0;
+  size_t destroyed_before = 0;
+};
+
+// Copies, moves and resets of handles to a few shared roots.
+template <typename Policy>
+void copy_and_reset(const char* name) {
+  constexpr size_t root_count = 4;
+  constexpr size_t slots = 8;
+  std::vector<shared_ptr<payload, Policy>> roots;
+  for (uint32_t i = 0; i != root_count; ++i) {
+    roots.push_back(make_shared<payload, Policy>(i));
+  }
+  const auto& shared_roots = roots;
+  run_threads(name, thread_count(), [&](size_t, std::minstd_rand& random) {
+    std::vector<shared_ptr<payload, Policy>> local(slots);
+    for (size_t n = iterations(); n != 0; --n) {
+      auto& slot = local[random() % slots];
+      switch (random() % 5) {
+      case 0:
+        slot = shared_roots[random() % root_count];
+        break;
+      case 1:
+        slot = local[random() % slots];
+        break;
+      case 2:
+        slot = std::move(local[random() % slots]);
+        break;
+      case 3:
+        slot.reset();
+        break;
+      default:
+        if (slot) {
+          EXPECT_GT(root_count, slot->check());
+        }
+      }
+    }
+  });
+  if constexpr (std::is_same_v<Policy, biased_policy>) {
+    // The roots were made here, so the other threads queued their last
+    // decrements to this one.
+    biased_policy::merge_queued();
+  }
+  for (auto& root : roots) {
+    EXPECT_EQ(1, root.use_count());
+  }
+}
+} // namespace
+
+TEST_F(stress_testing, copy_and_reset) {
+  copy_and_reset<atomic_policy>("copy_and_reset");
+  expect_all_destroyed();
+}
+
+TEST_F(stress_testing, copy_and_reset_biased) {
+  copy_and_reset<biased_policy>("copy_and_reset_biased");
+  expect_all_destroyed();
+}
+
+// weak_ptr::lock() racing with the release of the last strong handles,
+// which every thread drops at a random point.
+TEST_F(stress_testing, lock_against_last_release) {
+  constexpr size_t objects = 64;
+  size_t threads = thread_count();
+  std::vector<weak_ptr<payload>> weak;
+  std::vector<std::vector<shared_ptr<payload>>> strong(threads);
+  {
+    std::vector<shared_ptr<payload>> made;
+    for (uint32_t i = 0; i != objects; ++i) {
+      made.push_back(make_shared<payload>(i));
+      weak.push_back(made.back());
+    }
+    for (auto& handles : strong) {
+      handles = made;
+    }
+  }
+  const auto& shared_weak = weak;
+  run_threads("lock_against_last_release", threads,
+              [&](size_t index, std::minstd_rand& random) {
+                auto& mine = strong[index];
+                for (size_t n = iterations(); n != 0; --n) {
+                  size_t i = random() % objects;
+                  if (random() % 64 == 0) {
+                    mine[i].reset();
+                  } else if (auto locked = shared_weak[i].lock()) {
+                    EXPECT_EQ(i, locked->check());
+                  }
+                }
+                mine.clear();
+              });
+  for (auto& w : weak) {
+    EXPECT_TRUE(w.expired());
+  }
+  weak.clear();
+  expect_all_destroyed();
+}
+
+// Loads, stores, exchanges and compare-exchanges on a few shared slots.
+TEST_F(stress_testing, atomic_shared_ptr_exchange) {
+  constexpr size_t slot_count = 4;
+  atomic_shared_ptr<payload> slots[slot_count];
+  for (auto& slot : slots) {
+    slot.store(make_shared<payload>(0));
+  }
+  run_threads("atomic_shared_ptr_exchange", thread_count(),
+              [&](size_t index, std::minstd_rand& random) {
+                auto value = static_cast<uint32_t>(index);
+                for (size_t n = iterations(); n != 0; --n) {
+                  auto& slot = slots[random() % slot_count];
+                  switch (random() % 4) {
+                  case 0:
+                    if (auto p = slot.load()) {
+                      p->check();
+                    }
+                    break;
+                  case 1:
+                    slot.store(make_shared<payload>(value));
+                    break;
+                  case 2:
+                    if (auto old = slot.exchange(make_shared<payload>(value))) {
+                      old->check();
+                    }
+                    break;
+                  default: {
+                    auto expected = slot.load();
+                    slot.compare_exchange_strong(expected,
+                                                 make_shared<payload>(value));
+                  }
+                  }
+                }
+              });
+  for (auto& slot : slots) {
+    slot.store(shared_ptr<payload>());
+  }
+  hazard_pointers::reclaim();
+  expect_all_destroyed();
+}
@@ -265,6 +265,9 @@ void operator delete(void* ptr, size_t) noexcept {
   free(ptr);
 }
 
+// The control block pool takes its memory from slabs, not from one
+// operator new call per block.
+#ifndef SHARED_PTR_POOL_CONTROL_BLOCKS
 TEST(shared_ptr_testing, weak_ptr_allocations) {
   size_t new_calls_before = new_calls;
   size_t delete_calls_before = delete_calls;
@@ -280,6 +283,7 @@ TEST(shared_ptr_testing, weak_ptr_allocations) {
   EXPECT_EQ(delete_calls_after - delete_calls_before, 1);
   EXPECT_FALSE(w_p.lock());
 }
+#endif
 
 TEST(shared_ptr_testing, make_shared_weak_ptr_allocations) {
   size_t new_calls_before = new_calls;
@@ -296,6 +300,7 @@ TEST(shared_ptr_testing, make_shared_weak_ptr_allocations) {
   EXPECT_FALSE(w_p.lock());
 }
 
+#ifndef SHARED_PTR_POOL_CONTROL_BLOCKS
 TEST(shared_ptr_testing, allocations) {
   size_t new_calls_before = new_calls;
   size_t delete_calls_before = delete_calls;
@@ -309,6 +314,7 @@ TEST(shared_ptr_testing, allocations) {
   EXPECT_EQ(new_calls_after - new_calls_before, 2);
   EXPECT_EQ(delete_calls_after - delete_calls_before, 2);
 }
+#endif
 
 TEST(shared_ptr_testing, make_shared_allocations) {
   size_t new_calls_before = new_calls;